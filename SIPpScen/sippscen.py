@@ -194,6 +194,7 @@ if __name__ == "__main__":
 
                 call_duration = u.translate_time_signature(str(scn_data["call-duration"]))
                 conf['duration'] = call_duration      # media-server duration is in ms
+                conf['tag'] = u.media_tag(scn_data.get("media-tag", scn_name))   # media-server quality rollups
                 conf['ports_file'] = os.path.basename(csv_file_ports)
                 conf['dn_file'] = os.path.basename(csv_file_dn)
                 conf['refer_pause'] = REFER_PAUSE_SEC * 1_000
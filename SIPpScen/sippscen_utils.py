@@ -2,6 +2,7 @@ import requests, socket
 import subprocess
 import asyncio
 import re, os, time, glob
+import urllib.parse
 from collections import Counter
 from typing import Tuple
 from datetime import datetime
@@ -34,6 +35,17 @@ def get_epoch_ms() -> int:
     """
     return int(time.time()*1_000)
 
+MEDIA_TAG_MAX = 31     # media-server's TAG_SZ, with its terminating NUL
+
+def media_tag(name: str) -> str:
+    """
+    A media-server group tag, from a scenario name: the characters it does not
+    accept (letters, digits, '.', '-' and '_' only) replaced by '_', truncated,
+    and URL-encoded for the /stream query
+    """
+    tag = re.sub(r"[^A-Za-z0-9._-]", "_", str(name))[:MEDIA_TAG_MAX]
+    return urllib.parse.quote(tag, safe="")
+
 def dn_prefix(dn_start: int, n_ports: int) -> Tuple[str, int]:
     """
     The common prefix of [dn_start, dn_start+n_ports] range,
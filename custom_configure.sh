@@ -15,4 +15,10 @@
   	--disable-openh264      \
   	--disable-vpx           
 
-#-DPJMEDIA_STREAM_ENABLE_XR -DPJMEDIA_HAS_RTCP_XR
+# RTCP-XR (the endpoints' --rtcp-xr): in config_site.h, for the installed
+# headers' structures to match the library's
+CONFIG_SITE=pjlib/include/pj/config_site.h
+grep -q PJMEDIA_HAS_RTCP_XR $CONFIG_SITE 2>/dev/null || cat >> $CONFIG_SITE <<EOF
+#define PJMEDIA_HAS_RTCP_XR 1
+#define PJMEDIA_STREAM_ENABLE_XR 1
+EOF
@@ -0,0 +1,97 @@
+#ifndef CALL_PLAN_H
+#define CALL_PLAN_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include "shared_list.h"
+#include "timer_wheel.h"
+
+// Remote RTP target: an address and a range of ports, used in turn
+typedef struct PlanTarget_t {
+    std::string address;
+    int port_first;
+    int port_last;
+} PlanTarget;
+
+// A load plan, in the spirit of the scenarios' `pattern`: calls started
+// at cps, changing to pattern[i] after each timepoints[i] (ms, each one
+// after the previous), and repeated if so
+typedef struct PlanConfig_t {
+    double cps = 1;
+    std::vector<unsigned> timepoints;
+    std::vector<double> pattern;
+    bool repeat = false;
+    unsigned call_duration = 10000;     // ms
+    unsigned long total_calls = 0;      // 0: unlimited
+    unsigned duration = 0;              // the plan's, ms; 0: until stopped
+    int port_first = 0;                 // local RTP ports, used in turn
+    int port_last = 0;
+    std::vector<PlanTarget> targets;
+    bool client = false;
+    bool bidir = false;
+    unsigned short ptime = 0;           // packetization of the calls
+    unsigned short dtx = 0;
+} PlanConfig;
+
+// What the plan does, through media_server
+typedef struct PlanActions_t {
+    std::function<bool(int port)> port_free;            // no active endpoint on it
+    std::function<bool(const Data& data)> start_call;   // false if not admitted
+    std::function<void(int port)> end_call;             // for the non-client ones
+} PlanActions;
+
+// Executes a plan on a thread of its own, on a timer wheel
+class CallPlan {
+    PlanConfig config;
+    PlanActions actions;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> finished{false};  // no more calls to start
+    std::chrono::steady_clock::time_point started;
+    mutable std::mutex m;               // start, stop and status
+
+    // state of the plan's thread
+    TimerWheel *wheel = nullptr;
+    double current_cps = 0;
+    unsigned generation = 0;            // of the current cps
+    double credit = 0;                  // calls due
+    std::chrono::steady_clock::time_point last_fire;
+    size_t next_timepoint = 0;
+    int next_port = 0;
+    size_t next_target = 0;
+    std::vector<int> dest_ports;        // next one, per target
+
+    // statistics
+    std::atomic<double> cps_now{0};
+    std::atomic<unsigned long> calls{0};
+    std::atomic<unsigned long> rejected{0};     // not admitted by media_server
+    std::atomic<unsigned long> blocked{0};      // no free local port
+    std::atomic<unsigned long> ended{0};
+
+    void run();
+    void set_cps(double cps);
+    void schedule_call(unsigned gen);
+    void start_call();
+    void schedule_timepoint();
+
+public:
+    ~CallPlan();
+    bool start(const PlanConfig& config, const PlanActions& actions);
+    void stop();                        // the non-client calls are ended
+    bool is_running() const { return running; }
+    std::string status() const;
+
+    // e.g. "1m30s", "500ms"; seconds by default
+    static bool parse_time(const std::string& time_sign, unsigned *ms);
+    // "FIRST-LAST", or a single port
+    static bool parse_range(const std::string& range, int *first, int *last);
+    // "ADDRESS:PORT[-PORT],..."
+    static bool parse_targets(const std::string& targets, std::vector<PlanTarget>& out);
+};
+
+#endif
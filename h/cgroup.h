@@ -0,0 +1,44 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <string>
+#include <sys/types.h>
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+// Resource usage of a cgroup, from its cpu.stat and memory.current
+typedef struct CgroupUsage_t {
+    unsigned long long cpu_usec;
+    unsigned long long user_usec;
+    unsigned long long system_usec;
+    unsigned long long throttled_usec;
+    unsigned long long nr_throttled;
+    unsigned long long memory;          // bytes
+} CgroupUsage;
+
+// A cgroup v2 directory
+class Cgroup {
+    std::string path;               // empty if not set up
+
+    bool write(const char* file, const std::string& value) const;
+
+public:
+    Cgroup() {}
+    explicit Cgroup(const std::string& path) : path(path) {}
+    static Cgroup self();           // the cgroup of the calling process
+
+    bool valid() const { return !path.empty(); }
+    const std::string& get_path() const { return path; }
+    Cgroup child(const std::string& name) const;   // created, if needed
+    bool remove() const;
+    bool enable_controllers(const std::string& controllers) const;
+    bool attach(pid_t pid) const;   // pid 0: the calling process
+    // cgroup.procs, opened for a forked child to attach itself with
+    // write(fd, "0", 1), async-signal-safe; -1 if it fails
+    int open_procs() const;
+    bool set_cpu_limit(double cpus) const;
+    bool set_memory_limit(unsigned long long bytes) const;
+    CgroupUsage usage() const;
+};
+
+#endif
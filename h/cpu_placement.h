@@ -0,0 +1,24 @@
+#ifndef CPU_PLACEMENT_H
+#define CPU_PLACEMENT_H
+
+#include <string>
+#include <vector>
+
+// Round-robin placement of the endpoints on a configured CPU set
+class CpuPlacement {
+    std::vector<int> cpus;      // in placement order
+    size_t next = 0;
+
+    static std::vector<int> numa_nodes(const std::vector<int>& cpus);
+
+public:
+    // cpu_list as in cpuset(7), e.g. "2-7,10"; if numa_spread, consecutive
+    // placements alternate between the NUMA nodes of the set
+    bool configure(const std::string& cpu_list, bool numa_spread);
+    bool configured() const { return !cpus.empty(); }
+    int next_cpu();             // -1 if not configured
+    static int numa_node(int cpu);
+    static bool parse_cpu_list(const std::string& cpu_list, std::vector<int>& cpus);
+};
+
+#endif
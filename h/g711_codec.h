@@ -0,0 +1,56 @@
+#ifndef G711_CODEC_H
+#define G711_CODEC_H
+
+#include <pjmedia.h>
+#include <pjmedia-codec.h>
+#include "g711_simd.h"
+
+/*
+    PCMU/PCMA codecs on the SIMD G.711 kernels (the best ones the CPU
+    supports), registered in place of pjmedia's own G.711 codecs. Same
+    payload types, frames (10 ms), PLC and VAD as pjmedia's.
+*/
+class G711Codec
+{
+    pjmedia_codec base;             // must be first; pjmedia casts it back
+    const G711Kernels *kernels;
+    pjmedia_plc *plc;
+    pjmedia_silence_det *vad;
+    bool plc_enabled;
+    bool vad_enabled;
+    pj_timestamp last_tx;
+
+    static G711Codec *from(pjmedia_codec *codec);
+
+    /* pjmedia_codec_factory_op */
+    static pj_status_t test_alloc(pjmedia_codec_factory *factory, const pjmedia_codec_info *info);
+    static pj_status_t default_attr(pjmedia_codec_factory *factory, const pjmedia_codec_info *info,
+                                    pjmedia_codec_param *attr);
+    static pj_status_t enum_info(pjmedia_codec_factory *factory, unsigned *count,
+                                 pjmedia_codec_info codecs[]);
+    static pj_status_t alloc_codec(pjmedia_codec_factory *factory, const pjmedia_codec_info *info,
+                                   pjmedia_codec **p_codec);
+    static pj_status_t dealloc_codec(pjmedia_codec_factory *factory, pjmedia_codec *codec);
+    static pj_status_t destroy_factory(void);
+
+    /* pjmedia_codec_op */
+    static pj_status_t init(pjmedia_codec *codec, pj_pool_t *pool);
+    static pj_status_t open(pjmedia_codec *codec, pjmedia_codec_param *attr);
+    static pj_status_t close(pjmedia_codec *codec);
+    static pj_status_t modify(pjmedia_codec *codec, const pjmedia_codec_param *attr);
+    static pj_status_t parse(pjmedia_codec *codec, void *pkt, pj_size_t pkt_size,
+                             const pj_timestamp *ts, unsigned *frame_cnt, pjmedia_frame frames[]);
+    static pj_status_t encode(pjmedia_codec *codec, const pjmedia_frame *input,
+                              unsigned output_buf_len, pjmedia_frame *output);
+    static pj_status_t decode(pjmedia_codec *codec, const pjmedia_frame *input,
+                              unsigned output_buf_len, pjmedia_frame *output);
+    static pj_status_t recover(pjmedia_codec *codec, unsigned output_buf_len,
+                               pjmedia_frame *output);
+
+public:
+    // register the factory, in place of pjmedia's G.711; only the codec
+    // of codec_id (PCMU or PCMA), if given
+    static pj_status_t register_factory(pjmedia_endpt *endpt, const char *codec_id = nullptr);
+};
+
+#endif
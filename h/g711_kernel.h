@@ -0,0 +1,157 @@
+#ifndef G711_KERNEL_H
+#define G711_KERNEL_H
+
+// G.711 kernels, specialised at compile time per law (and per vector
+// type), so that their loops do not dispatch per sample. To be included
+// by the translation units built for each instruction set.
+//
+// Bit-exact with the reference (Sun) implementation, as used by pjmedia:
+// - u-law: |pcm| (clipped to 32635) plus a bias of 0x84, in 8 segments;
+//   a segment's mantissa is the 4 bits under its leading one
+// - A-law: |pcm| - 8 for the negative ones, the two first segments
+//   sharing the same step
+
+#include "g711_simd.h"
+
+#define G711_ULAW_BIAS  0x84
+#define G711_ULAW_CLIP  32635
+
+// one sample; the scalar kernels and the vector ones' tails
+template<g711_law LAW> inline uint8_t g711_encode_sample(int16_t pcm);
+template<g711_law LAW> inline int16_t g711_decode_sample(uint8_t code);
+
+static inline int g711_segment(int v)
+{
+    int seg = 0;
+    for (int end = 0xFF; seg < 7 && v > end; end = (end << 1) | 1)
+        seg++;
+    return seg;
+}
+
+template<> inline uint8_t g711_encode_sample<g711_ulaw>(int16_t pcm)
+{
+    int mask = (pcm < 0)? 0x7F : 0xFF;
+    int v = (pcm < 0)? -pcm : pcm;
+    if (v > G711_ULAW_CLIP)
+        v = G711_ULAW_CLIP;
+    v += G711_ULAW_BIAS;
+    int seg = g711_segment(v);
+    return ((seg << 4) | ((v >> (seg + 3)) & 0xF)) ^ mask;
+}
+
+template<> inline int16_t g711_decode_sample<g711_ulaw>(uint8_t code)
+{
+    int u = ~code & 0xFF;
+    int t = (((u & 0xF) << 3) + G711_ULAW_BIAS) << ((u & 0x70) >> 4);
+    return (u & 0x80)? G711_ULAW_BIAS - t : t - G711_ULAW_BIAS;
+}
+
+template<> inline uint8_t g711_encode_sample<g711_alaw>(int16_t pcm)
+{
+    int mask = (pcm < 0)? 0x55 : 0xD5;
+    int v = (pcm < 0)? -pcm - 8 : pcm;
+    if (v < 0)
+        v = 0;
+    int seg = g711_segment(v);
+    int shift = ((seg)? seg : 1) + 3;
+    return ((seg << 4) | ((v >> shift) & 0xF)) ^ mask;
+}
+
+template<> inline int16_t g711_decode_sample<g711_alaw>(uint8_t code)
+{
+    int a = code ^ 0x55;
+    int seg = (a & 0x70) >> 4;
+    int t = ((a & 0xF) << 4) + ((seg)? 0x108 : 8);
+    if (seg > 1)
+        t <<= seg - 1;
+    return (a & 0x80)? t : -t;
+}
+
+template<g711_law LAW>
+void g711_encode_scalar(const int16_t *pcm, uint8_t *out, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = g711_encode_sample<LAW>(pcm[i]);
+}
+
+template<g711_law LAW>
+void g711_decode_scalar(const uint8_t *in, int16_t *pcm, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        pcm[i] = g711_decode_sample<LAW>(in[i]);
+}
+
+/*
+    Vector kernels, on 16-bit lanes. V provides the operations on a
+    register of V::lanes samples; the variable shifts are multiplications
+    by powers of 2, looked up with a byte shuffle.
+*/
+
+// segment: the count of the segment ends below v (v <= 0x7FFF)
+template<class V> static inline typename V::reg g711_segment(typename V::reg v)
+{
+    typename V::reg seg = V::zero();
+    for (int end = 0xFF; end < 0x7FFF; end = (end << 1) | 1)
+        seg = V::sub(seg, V::cmpgt(v, V::set1(end)));   // -1 if above
+    return seg;
+}
+
+template<class V, g711_law LAW>
+void g711_encode_vector(const int16_t *pcm, uint8_t *out, size_t n)
+{
+    typedef typename V::reg reg;
+    size_t i = 0;
+    for (; i + V::lanes <= n; i += V::lanes) {
+        reg x = V::load_pcm(pcm + i);
+        reg negative = V::cmpgt(V::zero(), x);
+        reg v, mask;
+        if (LAW == g711_ulaw) {
+            // the absolute value, as unsigned: 32768 for -32768
+            v = V::add(V::min_epu16(V::abs(x), V::set1(G711_ULAW_CLIP)), V::set1(G711_ULAW_BIAS));
+            mask = V::xor_(V::set1(0xFF), V::and_(negative, V::set1(0x80)));
+        } else {
+            // -pcm - 8 = ~pcm - 7, floored at 0
+            reg neg_v = V::subs_epu16(V::xor_(x, V::set1(-1)), V::set1(7));
+            v = V::or_(V::and_(negative, neg_v), V::andnot(negative, x));
+            mask = V::xor_(V::set1(0xD5), V::and_(negative, V::set1(0x80)));
+        }
+        reg seg = g711_segment<V>(v);
+        // mantissa: v >> (seg + 3) = v * 2^(13 - seg) >> 16
+        reg shift_seg = (LAW == g711_ulaw)? seg : V::max_epi16(seg, V::set1(1));
+        reg mult = V::template slli<6>(V::pow2(V::sub(V::set1(7), shift_seg)));
+        reg mant = V::and_(V::mulhi_epu16(v, mult), V::set1(0xF));
+        reg code = V::xor_(V::or_(V::template slli<4>(seg), mant), mask);
+        V::store_bytes(out + i, code);
+    }
+    g711_encode_scalar<LAW>(pcm + i, out + i, n - i);
+}
+
+template<class V, g711_law LAW>
+void g711_decode_vector(const uint8_t *in, int16_t *pcm, size_t n)
+{
+    typedef typename V::reg reg;
+    size_t i = 0;
+    for (; i + V::lanes <= n; i += V::lanes) {
+        reg x = V::load_bytes(in + i);
+        reg t, negative;
+        if (LAW == g711_ulaw) {
+            reg u = V::xor_(x, V::set1(0xFF));
+            reg seg = V::template srli<4>(V::and_(u, V::set1(0x70)));
+            t = V::add(V::template slli<3>(V::and_(u, V::set1(0xF))), V::set1(G711_ULAW_BIAS));
+            t = V::sub(V::mullo(t, V::pow2(seg)), V::set1(G711_ULAW_BIAS));
+            negative = V::cmpgt(V::and_(u, V::set1(0x80)), V::zero());
+        } else {
+            reg a = V::xor_(x, V::set1(0x55));
+            reg seg = V::template srli<4>(V::and_(a, V::set1(0x70)));
+            reg step = V::add(V::set1(8), V::andnot(V::cmpeq(seg, V::zero()), V::set1(0x100)));
+            t = V::add(V::template slli<4>(V::and_(a, V::set1(0xF))), step);
+            t = V::mullo(t, V::pow2(V::subs_epu16(seg, V::set1(1))));
+            negative = V::cmpeq(V::and_(a, V::set1(0x80)), V::zero());
+        }
+        // negated where negative: (t ^ -1) - (-1)
+        V::store_pcm(pcm + i, V::sub(V::xor_(t, negative), negative));
+    }
+    g711_decode_scalar<LAW>(in + i, pcm + i, n - i);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef G711_SIMD_H
+#define G711_SIMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum g711_law {g711_ulaw=0, g711_alaw};
+enum g711_isa {isa_scalar=0, isa_sse41, isa_avx2, isa_best};
+
+typedef void (*g711_encode_fn)(const int16_t *pcm, uint8_t *out, size_t n);
+typedef void (*g711_decode_fn)(const uint8_t *in, int16_t *pcm, size_t n);
+
+// G.711 encode/decode kernels, of a law, for an instruction set
+typedef struct G711Kernels_t {
+    g711_encode_fn encode;
+    g711_decode_fn decode;
+    const char *isa;
+} G711Kernels;
+
+// isa_best: the best one the CPU supports; NULL if the CPU does not
+// support the one asked
+const G711Kernels* g711_kernels(g711_law law, g711_isa isa = isa_best);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef GROUP_STATS_H
+#define GROUP_STATS_H
+
+#include <time.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "shared_list.h"         // StreamQuality, TAG_SZ
+
+#define GROUP_SLICE 10              // sec
+#define GROUP_SLICES 30             // the rolling window: 5 min
+#define GROUPS_MAX 256
+#define MOS_BINS 41                 // 1.0 to 5.0, by 0.1
+#define LOSS_BINS 51                // 0 to 25 %, by 0.5; the last one: above
+#define JITTER_BINS 101             // 0 to 100 ms, by 1; the last one: above
+
+// A figure's distribution over the window
+typedef struct Distribution_t {
+    double mean;
+    float min;
+    float max;
+    float p5;
+    float p50;
+    float p95;
+} Distribution;
+
+// A direction of a group's streams, over the window
+typedef struct DirSummary_t {
+    unsigned long reports;
+    Distribution mos;
+    Distribution loss_pct;
+    Distribution jitter_ms;
+} DirSummary;
+
+typedef struct GroupSummary_t {
+    std::string tag;
+    unsigned streams;               // active, now
+    DirSummary tx;
+    DirSummary rx;
+} GroupSummary;
+
+/*
+    Rolling aggregates of the streams' quality reports, per group tag and
+    direction: the window's time slices each hold the reports' count, sums,
+    extremes and histograms, so that a summary merges at most GROUP_SLICES
+    of them, whatever the number of reports. Percentiles are of the
+    histograms' bins.
+*/
+class GroupStats {
+    struct Slice {
+        time_t start = 0;           // 0: empty
+        unsigned long reports = 0;
+        double sum[3] = {};         // mos, loss, jitter
+        float min[3] = {};
+        float max[3] = {};
+        unsigned mos_hist[MOS_BINS] = {};
+        unsigned loss_hist[LOSS_BINS] = {};
+        unsigned jitter_hist[JITTER_BINS] = {};
+    };
+    struct Group {
+        Slice tx[GROUP_SLICES];
+        Slice rx[GROUP_SLICES];
+    };
+    std::map<std::string, Group> groups;
+    unsigned long dropped = 0;      // reports of the groups above GROUPS_MAX
+    mutable std::mutex m;
+
+    static void add(Slice *slices, const StreamQuality& quality, time_t now);
+    static bool stale(const Slice *slices, time_t now);     // nothing in the window
+    static DirSummary summary(const Slice *slices, time_t now, unsigned window);
+
+public:
+    void add(const std::string& tag, const StreamQuality& tx, const StreamQuality& rx,
+             time_t now);
+    // window: sec, up to GROUP_SLICES * GROUP_SLICE; streams: active, per tag
+    std::vector<GroupSummary> summary(time_t now, unsigned window,
+                                      const std::map<std::string, unsigned>& streams) const;
+    unsigned long reports_dropped() const;
+    // a window, in whole slices: GROUP_SLICE to GROUP_SLICES * GROUP_SLICE sec
+    static unsigned window_of(unsigned sec);
+    // letters, digits, '-', '_' and '.'; fits Data.tag
+    static bool valid_tag(const std::string& tag);
+};
+
+#endif
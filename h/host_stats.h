@@ -0,0 +1,34 @@
+#ifndef HOST_STATS_H
+#define HOST_STATS_H
+
+#include <mutex>
+
+// Host's load figures, as read from /proc
+typedef struct HostLoad_t {
+    double cpu_idle;                    // % of the last sampling period
+    unsigned cpus;
+    unsigned long mem_total;            // kB
+    unsigned long mem_available;        // kB
+    unsigned long udp_in;               // UDP datagrams received
+    unsigned long udp_in_errors;        // UDP datagrams dropped
+    unsigned long udp_rcvbuf_errors;    // ... of which, on full receive buffers
+    unsigned long udp_sndbuf_errors;
+} HostLoad;
+
+class HostStats {
+    mutable std::mutex mutex;
+    HostLoad current = {};
+    unsigned long long cpu_total = 0;
+    unsigned long long cpu_idle = 0;
+
+    void read_cpu(HostLoad &load);
+    static void read_memory(HostLoad &load);
+    static void read_udp(HostLoad &load);
+
+public:
+    HostStats();
+    void sample();                      // CPU idle is measured between samples
+    HostLoad load() const;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef IMPAIRMENT_H
+#define IMPAIRMENT_H
+
+#include <stdint.h>
+#include <random>
+
+// distributions of the added delay (jitter)
+enum jitter_dist {
+    jd_uniform = 0,     // 0 to twice the mean
+    jd_normal,          // sd half the mean, floored at 0
+    jd_pareto,          // heavy tail, capped at 10 times the mean
+};
+
+// A stream's impairment profile, of its sent RTP packets; all 0: none
+typedef struct ImpairProfile_t {
+    float loss;                     // %, on average
+    float burst;                    // mean loss burst, in packets (>= 1)
+    unsigned short jitter_ms;       // mean added delay
+    unsigned short jitter_dist;     // jitter_dist
+    float reorder;                  // %: sent after the next packet
+    float dup;                      // %: sent twice
+    unsigned int seed;              // of the random draws; 0: random
+} ImpairProfile;
+
+// The packets impaired, since the profile was set
+typedef struct ImpairStat_t {
+    unsigned long packets;
+    unsigned long lost;
+    unsigned long duplicated;
+    unsigned long reordered;
+    unsigned long long delay_us;    // added, summed over the packets sent
+} ImpairStat;
+
+// What happens to a packet
+typedef struct ImpairVerdict_t {
+    bool drop;
+    bool dup;
+    bool reorder;
+    unsigned delay_us;
+} ImpairVerdict;
+
+bool impair_active(const ImpairProfile *profile);
+bool impair_delays(const ImpairProfile *profile);   // jitter or reorder
+const char *jitter_dist_name(unsigned dist);
+int jitter_dist_parse(const char *name);            // -1 if unknown
+// the profile's consistency; NULL if valid, otherwise the reason
+const char *impair_check(const ImpairProfile *profile);
+
+/*
+    The random draws of a profile, per packet. Loss follows a
+    Gilbert-Elliott model: all the packets lost in the bad state, none in
+    the good one, the transitions set by the mean loss and burst length;
+    a burst of 1 is random (Bernoulli) loss. The same seed draws the same
+    sequence of verdicts.
+*/
+class Impairer {
+    ImpairProfile profile = {};
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> uniform{0.0, 1.0};
+    double p_bad = 0;               // good to bad, per packet
+    double p_good = 1;              // bad to good
+    bool bad = false;
+
+    unsigned jitter_us();
+
+public:
+    void configure(const ImpairProfile& profile);
+    ImpairVerdict next();
+};
+
+#endif
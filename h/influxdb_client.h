@@ -7,10 +7,12 @@
 class InfluxDBClient {
 public:
     InfluxDBClient();
+    // deferred: curl set up on the first send, off the startup path
     InfluxDBClient(const std::string& url,
                   const std::string& org,
                   const std::string& bucket,
-                  const std::string& token);
+                  const std::string& token,
+                  bool deferred = false);
     ~InfluxDBClient();
 
     bool send(const std::string& measurement,
@@ -31,6 +33,7 @@ private:
     std::string token_;
     bool connected_;
     bool not_connect_notify;
+    bool deferred_;
     CURL* curl_;
     struct curl_slist* headers_;
 };
@@ -0,0 +1,51 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <time.h>
+
+enum log_level {log_error=0, log_warning, log_info, log_debug};
+
+#define LOG_BURST   10          // messages per call site per second, before suppressing
+
+// Per call site rate limiting of repeated messages
+class LogRateLimit {
+    std::atomic<time_t> window{0};
+    std::atomic<unsigned> count{0};
+    std::atomic<unsigned> suppressed{0};
+
+public:
+    // false if over the burst; else the messages suppressed since the last one
+    bool allow(unsigned *n_suppressed);
+};
+
+// Asynchronous logger: each thread writes into its own lock-free ring
+// buffer, and a background thread drains them all to stdout. A thread
+// never blocks on the output; if its ring is full the message is dropped
+// (and counted).
+class Logger {
+public:
+    static void start();                    // the drain thread
+    static void stop();                     // drains what is left; before exit
+    static void set_level(log_level level);
+    static log_level level();
+    static const char* level_name(log_level level);
+    static bool parse_level(const char *name, log_level *level);
+    static unsigned long dropped();
+
+    static void log(log_level level, unsigned suppressed, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+    // unbuffered and async-signal-safe; e.g. between fork and exec
+    static void write_raw(const char *msg);
+};
+
+#define LOG(lvl, ...) do {                                          \
+    if ((lvl) <= Logger::level()) {                                 \
+        static LogRateLimit _rate_limit;                            \
+        unsigned _suppressed;                                       \
+        if (_rate_limit.allow(&_suppressed))                        \
+            Logger::log(lvl, _suppressed, __VA_ARGS__);             \
+    }                                                               \
+} while (0)
+
+#endif
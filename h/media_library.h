@@ -0,0 +1,101 @@
+#ifndef MEDIA_LIBRARY_H
+#define MEDIA_LIBRARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "shared_list.h"         // SOURCE_SZ
+
+#define SOURCE_MAGIC 0x4352534d     // "MSRC"
+#define SOURCE_GRACE 10             // sec: a source just acquired is not evicted
+
+// Header of a loaded source's shared memory; its PCM follows
+typedef struct SourceHeader_t {
+    uint32_t magic;
+    uint32_t clock_rate;
+    uint16_t channels;
+    uint16_t bits;
+    uint32_t size;                  // PCM bytes
+    uint8_t pad[48];                // the PCM 64-byte aligned
+} SourceHeader;
+
+// A source of the library, as listed
+typedef struct SourceInfo_t {
+    std::string name;
+    size_t size;                    // PCM bytes
+    bool loaded;
+    unsigned users;                 // endpoints playing it, or about to
+    time_t last_used;               // 0: never
+} SourceInfo;
+
+/*
+    The audio sources of a directory (*.wav: PCM 16-bit, mono, 8000 Hz),
+    by their file name without extension. A source is loaded on demand
+    into a POSIX shared memory object, <prefix>.<name>, that the endpoints
+    playing it map read-only: one copy however many play it. Under the
+    memory budget, the least recently used sources that no endpoint uses
+    are unloaded.
+*/
+class MediaLibrary {
+    struct Source {
+        std::string path;
+        size_t offset;              // of the PCM, in the file
+        size_t size;
+        bool loaded = false;
+        time_t last_used = 0;
+    };
+    std::map<std::string, Source> sources;
+    std::string prefix;             // of the shared memory objects
+    size_t budget = 0;              // bytes; 0: unlimited
+    size_t used = 0;                // bytes loaded
+    mutable std::mutex m;
+
+    bool load(const std::string& name, Source& source, std::string& error);
+    void unload(const std::string& name, Source& source);
+    bool evict(size_t needed, const std::map<std::string, unsigned>& users);
+
+public:
+    ~MediaLibrary();
+    // scan dir; the invalid files are skipped, with a warning each
+    bool open(const std::string& dir, const std::string& prefix, size_t budget,
+              std::string& error);
+    bool empty() const { return sources.empty(); }
+    bool has(const std::string& name) const;
+    // the source loaded, evicting unused ones if needed; users: per source
+    // name. false, with the reason, if over the budget
+    bool acquire(const std::string& name, const std::map<std::string, unsigned>& users,
+                 std::string& error);
+    std::vector<SourceInfo> list(const std::map<std::string, unsigned>& users) const;
+    size_t memory_used() const;
+    size_t memory_budget() const { return budget; }
+    static std::string shm_name(const std::string& prefix, const std::string& name);
+    static bool valid_name(const std::string& name);
+};
+
+// A loaded source, as mapped by an endpoint
+class MediaSource {
+    const uint8_t *map = nullptr;
+    size_t map_size = 0;
+    std::string source_name;
+
+public:
+    MediaSource() {}
+    MediaSource(const MediaSource&) = delete;
+    MediaSource& operator=(const MediaSource&) = delete;
+    ~MediaSource() { close(); }
+    bool open(const std::string& shm_name, const std::string& name, std::string& error);
+    void close();
+    void swap(MediaSource& other);
+
+    bool valid() const { return map != nullptr; }
+    const std::string& name() const { return source_name; }
+    const void *pcm() const { return map + sizeof(SourceHeader); }
+    size_t size() const { return ((const SourceHeader *)map)->size; }
+    unsigned clock_rate() const { return ((const SourceHeader *)map)->clock_rate; }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PCAP_REPLAY_H
+#define PCAP_REPLAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// An RTP packet of the capture: where it is in the mapped file, and its
+// header fields to be rewritten
+typedef struct ReplayPacket_t {
+    size_t offset;              // of the RTP header, in the file
+    uint16_t len;               // RTP header and payload
+    uint16_t seq;
+    uint32_t ts;
+    uint64_t time_ns;           // capture time, from the flow's first packet
+} ReplayPacket;
+
+/*
+    An RTP flow of a pcap or pcapng capture, to be replayed. The file is
+    memory-mapped, read-only, and the flow's packets are indexed once; the
+    replay reads them in place.
+    Captures of Ethernet (VLAN tagged or not), Linux cooked (v1, v2) or raw
+    IP, and RTP over UDP over IPv4/IPv6 (not fragmented).
+*/
+class PcapReplay {
+    const uint8_t *map = nullptr;
+    size_t map_size = 0;
+    std::vector<ReplayPacket> packets;
+    uint32_t ssrc = 0;              // the flow's, and its UDP destination port
+    uint16_t flow_port = 0;
+    uint64_t step_ns = 0;       // from the last packet to the first one, on a loop
+    uint32_t step_ts = 0;
+
+    bool index(const std::string& flow, std::string& error);
+    bool index_pcap(uint16_t want_port, uint32_t want_ssrc, bool by_ssrc, std::string& error);
+    bool index_pcapng(uint16_t want_port, uint32_t want_ssrc, bool by_ssrc, std::string& error);
+    void add_frame(int linktype, size_t offset, size_t caplen, uint64_t time_ns,
+                   uint16_t want_port, uint32_t want_ssrc, bool by_ssrc);
+
+public:
+    ~PcapReplay();
+    // flow: an SSRC (0x...), or a UDP destination port; empty: the first RTP flow
+    bool open(const char *path, const std::string& flow, std::string& error);
+
+    size_t count() const { return packets.size(); }
+    const ReplayPacket& packet(size_t i) const { return packets[i]; }
+    const uint8_t *data(const ReplayPacket& pkt) const { return map + pkt.offset; }
+    uint32_t flow_ssrc() const { return ssrc; }
+    uint64_t loop_ns() const;   // a loop's duration: first packet to first packet
+    uint32_t loop_ts() const;   // ... in RTP timestamp units
+    uint64_t duration_ns() const { return packets.empty()? 0 : packets.back().time_ns; }
+};
+
+#endif
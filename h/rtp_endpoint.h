@@ -10,6 +10,33 @@
 
 #include <stdlib.h> /* atoi() */
 #include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <string>
+
+#include "transport_adapter.h"
+#include "shared_list.h"         // StreamQuality
+
+/* RTCP-XR (RFC 3611), if pjmedia is built with it (custom_configure.sh) */
+#if defined(PJMEDIA_HAS_RTCP_XR) && (PJMEDIA_HAS_RTCP_XR != 0) && \
+    defined(PJMEDIA_STREAM_ENABLE_XR) && (PJMEDIA_STREAM_ENABLE_XR != 0)
+#define RTCP_XR_BUILT 1
+#else
+#define RTCP_XR_BUILT 0
+#endif
+#define XR_UNAVAILABLE 127              // VoIP metrics' R factor or MOS
+
+class PcapReplay;
+
+// the constructor's phases, timed (usec)
+typedef struct InitTimes_t {
+    unsigned pjlib;
+    unsigned media;             // caching pool, pjmedia endpoint and its worker thread
+    unsigned codecs;
+    unsigned transport;         // event manager, UDP transport
+} InitTimes;
 
 
 class RTP_endpoint
@@ -18,35 +45,100 @@ class RTP_endpoint
     pjmedia_transport *transport = NULL;
     pjmedia_endpt *med_endpt;
     pj_pool_t *pool;
+    pj_pool_t *stream_pool = NULL;      // released along with the stream
+    pj_pool_t *player_pool = NULL;      // released along with the file player
     pjmedia_port *play_file_port = NULL;
+    std::string play_source;            // the player's wavefile, or '@' and its library source
     pjmedia_master_port *master_port = NULL;
     pjmedia_stream *stream = NULL;
+    pjmedia_dir stream_dir = PJMEDIA_DIR_NONE;
+    unsigned ptime = 0;                 // 0: the codec's default
+    bool dtx = false;
+    unsigned stream_ptime = 0;          // the stream's, as created
+    bool stream_dtx = false;
+    bool kernel_ts = false;
+    bool owd = false;
+    bool rtcp_xr = false;
+    /* the sent stream's RTCP-XR counts, since its start, at the last report */
+    mutable pj_uint32_t xr_last_expected = 0;
+    mutable double xr_last_lost = 0;    // lost and discarded
+    pj_uint32_t stream_ssrc = 0;
+    bool stream_started = false;
     pjmedia_port *stream_port;
     pjmedia_stream_info info;
     pjmedia_codec_param codec_param;
     pj_uint16_t local_port;
+    int rt_prio = 0;
     pj_sockaddr_in remote_addr;
+    bool fast_start;
+    InitTimes init_times;
+    std::string srtp_suite;             // empty: plain RTP
+    std::string srtp_key;               // base64
+    ImpairProfile impair = {};          // of the sent packets
+
+    /* pcap replay, sent alongside the stream, in place of its own sending */
+    std::thread replay_thread;
+    std::mutex replay_m;
+    std::condition_variable replay_cv;
+    bool replay_stop = false;           // protected by replay_m
+    std::atomic<unsigned long> replay_sent{0};
+    pj_time_val replay_start;
+    pj_uint8_t replay_buf[PJMEDIA_MAX_MTU];
 
     pj_status_t status;
 
     pj_status_t createSocket(pj_sockaddr_in* socket, const char* ip_addr, pj_uint16_t port);
     pj_status_t createMemPool(const char* name="app", pj_size_t initial=4000, pj_size_t increment=0);
+    void destroyStream();
+    void destroyPlayer();
+    void createMasterPort();
+    void setTimestamping();
+    void startSrtp();
+    void replay(const PcapReplay *pcap, double speed);
     pj_status_t init_codecs(const pjmedia_codec_info** codec_info, const char* codec_id = nullptr);
     static const char *good_number(char *buf, unsigned buf_size, pj_int32_t val);
     float compute_MOS(float pkt_loss_rate, float rtt) const;
+    float compute_MOS(const pjmedia_rtcp_stat &stat, pjmedia_dir dir, const OwdStat *owd = nullptr,
+                      float xr_loss = -1) const;
+    static float loss_rate(const pjmedia_rtcp_stat &stat, pjmedia_dir dir, float xr_loss);
+    float xr_interval_loss(const pjmedia_rtcp_xr_stream_stat &xr) const;
 
 public:
     RTP_endpoint(pj_uint16_t local_port=4000, int log_level=1,
-        pjmedia_dir=PJMEDIA_DIR_ENCODING, const char* codec_id = nullptr);
+        pjmedia_dir=PJMEDIA_DIR_ENCODING, const char* codec_id = nullptr,
+        bool fast_start = false);
     ~RTP_endpoint();
+    void setRealtime(int prio);
+    void setDirection(pjmedia_dir dir);
+    void setPacketization(unsigned ptime, bool dtx);
+    void setKernelTimestamps(bool on);
+    void setOneWayDelay(bool on);
+    bool setRtcpXr(bool on);
+    void setSrtp(const char *suite, const char *key);
+    void setImpairment(const ImpairProfile &profile);
     void setRemoteAddr(const char* ip_addr, pj_uint16_t port);
     void createStream();
     void startStream();
     void startStream(const char* wavefile);
+    void startStream(const char* source, const void *pcm, pj_size_t size, unsigned clock_rate);
     void stopStreaming();
     void startStreaming();
+    void startReplay(const PcapReplay *pcap, double speed);
+    void stopReplay();
     void print_stream_stat() const;
+    pj_size_t getPoolUsage() const;
+    float getPacketRate() const;
+    bool getKernelTsStat(KernelTsStat *stat, bool reset) const;
+    bool getOwdStat(OwdStat *stat, bool reset) const;
+    bool getXrStat(pjmedia_rtcp_xr_stat *stat) const;
+    const InitTimes& getInitTimes() const { return init_times; }
+    pj_uint64_t getFirstPacketTime() const;
+    void onFirstPacket(void (*cb)(void *), void *arg);
+    void getSrtpStat(SrtpStat *stat) const;
+    void getImpairStat(ImpairStat *stat) const;
     float get_MOS() const;
+    void get_MOS(float *tx_mos, float *rx_mos) const;
+    void get_quality(StreamQuality *tx, StreamQuality *rx) const;
 };
 
 
@@ -3,12 +3,23 @@
 
 #include <iostream>
 #include <pthread.h>
+#include <time.h>
+#include "impairment.h"
 
 #define SHM_NAME "/media_server_shm"
+#define SHM_MAGIC 0x4d535247        // "MSRG"
+#define SHM_VERSION 9               // to be increased on any layout change
 #define ADDR_SZ 16
+#define SRTP_SUITE_SZ 24
+#define SRTP_KEY_SZ 68             // base64, of up to 46 bytes (AES-256 key and salt)
+#define SOURCE_SZ 32
+#define PROFILE_SZ 16
+#define DEFAULT_PROFILE "default"   // media_server's, of its -p, -w and -c
+#define TAG_SZ 32
 #ifndef MAX_NODES
 #define MAX_NODES 1000
 #endif
+#define JOURNAL_SZ 8192             // change events kept
 
 enum rc {
     ERROR = 0,
@@ -20,6 +31,50 @@ enum type_t {
     t_client,
 };
 
+// endpoint states, as kept in the registry
+enum ep_state {
+    ep_active = 0,
+    ep_idle,            // waiting to be reused
+    ep_released,        // told to exit
+};
+
+// commands to an endpoint; payload of its real-time signal
+enum ep_command {
+    cmd_reuse = 0,
+    cmd_release,
+    cmd_log_level,      // the level in the 2nd byte
+};
+
+// endpoint startup phases, timed in the registry (usec)
+enum startup_phase {
+    sp_exec = 0,        // from media_server's fork to the endpoint's main()
+    sp_args,            // arguments, and the replay capture's indexing
+    sp_registry,        // the shared memory attached
+    sp_influx,          // InfluxDB client (curl); 0 if deferred to the first report
+    sp_pjlib,           // pj_init
+    sp_media,           // caching pool, pjmedia endpoint and its worker thread
+    sp_codecs,
+    sp_transport,       // event manager, UDP transport
+    sp_stream,          // the first stream created and started
+    sp_first_packet,    // to the first RTP packet, sent or received
+    sp_total,           // from the fork to the first packet
+    SP_PHASES
+};
+
+// a direction of a stream, over an endpoint's report interval
+typedef struct StreamQuality_t {
+    float mos;                // 0: not measured
+    float loss_pct;
+    float jitter_ms;
+} StreamQuality;
+
+// the quality of an endpoint's last report; set by the endpoint
+typedef struct Quality_t {
+    unsigned int reports;     // of the endpoint's process: a new report when increased
+    StreamQuality tx;         // the sent stream, as reported back by the remote
+    StreamQuality rx;
+} Quality;
+
 typedef struct Data_t {
     int port;
     int dest_port;
@@ -27,18 +82,60 @@ typedef struct Data_t {
     int duration;
     pid_t pid;
     unsigned short client;    // 1 if a client
+    unsigned short bidir;     // 1 if send/recv (both directions)
+    unsigned int pool_used;   // endpoint's pool memory (bytes); set by the endpoint
+    unsigned short state;     // ep_state
+    unsigned int reuse_cnt;   // number of times the endpoint has been reused
+    time_t idle_since;        // when the endpoint became idle
+    short cpu;                // CPU the endpoint is pinned to; -1 if none
+    unsigned long long cpu_usec;    // CPU time used, from its cgroup (if any)
+    unsigned long long mem_bytes;   // memory used, from its cgroup (if any)
+    unsigned short ptime;     // packetization (ms); 0: the codec's default
+    unsigned short dtx;       // 1 if silence is not sent (VAD/DTX)
+    float pps;                // packets/s of the stream, last measured; set by the endpoint
+    unsigned long long spawn_ns;        // CLOCK_MONOTONIC, at media_server's fork
+    unsigned int startup_us[SP_PHASES]; // per startup_phase; set by the endpoint
+    char srtp[SRTP_SUITE_SZ];       // SRTP crypto suite; empty: plain RTP
+    char srtp_key[SRTP_KEY_SZ];     // its master key and salt, base64
+    unsigned long long srtp_cpu_ns; // CPU time in SRTP protect/unprotect; set by the endpoint
+    char source[SOURCE_SZ];         // media library source played; empty: the wavefile
+    ImpairProfile impair;           // of the sent RTP packets
+    char profile[PROFILE_SZ];       // media_server's profile the endpoint runs with
+    char tag[TAG_SZ];               // the caller's group label; empty: none
+    Quality quality;
 } Data;
 
+// change journal events
+enum journal_op {
+    jr_add = 0,
+    jr_update,
+    jr_remove,
+};
+
+typedef struct JournalEvent_t {
+    unsigned long long seq;
+    unsigned short op;        // journal_op
+    Data data;                // the element after the change (before, if removed)
+} JournalEvent;
+
 typedef struct ListNode_t {
     Data data;
     short next;
 } ListNode;
 
 typedef struct SharedLst_t {
-    pthread_mutex_t mutex;
+    unsigned int magic;
+    unsigned int version;
+    unsigned int size;              // sizeof(SharedLst)
+    pthread_mutex_t mutex;          // robust
+
     ListNode nodes[MAX_NODES];
     short head;
     short count;
+
+    // ring of the last JOURNAL_SZ changes; event seq is at [seq % JOURNAL_SZ]
+    unsigned long long seq;         // of the last change
+    JournalEvent journal[JOURNAL_SZ];
 } SharedLst;
 
 
@@ -50,18 +147,30 @@ class SharedList {
     char shared_mem_name[100];
     bool mutex_initialized = false;
     bool mutex_acquired = false;
+    bool persistent = false;
+
+    bool consistent() const;
+    void record(journal_op op, const Data *data);
 
 public:
     // if shared_mem_name is NULL, create a local list, for testing
     SharedList(type_t type=t_client, const char* shared_mem_name=SHM_NAME);
     ~SharedList();
     void initialize();              // should only be used by server
+    int adopt(bool (*alive)(pid_t pid));    // should only be used by server
+    void persist();                 // keep the shared memory on exit
     std::string print_list () const;
     static const char* print_element (Data *data);
     int add_element(Data *data);
     int update_element(Data *data);
     int remove_element(int port);
     Data* fetch_element(int port) const;
+    int fetch_elements(Data **elements, int max) const;
+    void touch(Data *data);         // journal an element changed in place
+    unsigned long long snapshot(Data *elements, int max, int *count) const;
+    int changes(unsigned long long since, JournalEvent *events, int max,
+                unsigned long long *seq) const;
+    unsigned long long journal_seq() const;
     void lock();
     void unlock();
 
@@ -0,0 +1,49 @@
+#ifndef THREAD_STATS_H
+#define THREAD_STATS_H
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+#define THREAD_NAME_SZ 16           // with the '\0', as the kernel keeps it
+
+// A thread's figures, from /proc/PID/task/TID
+typedef struct ThreadStat_t {
+    pid_t tid;
+    std::string name;
+    const char *subsystem;
+    char state;                     // R, S, D...
+    unsigned long long user_us;     // CPU time
+    unsigned long long system_us;
+    unsigned long voluntary;        // context switches: waits, then wakeups
+    unsigned long involuntary;      // preemptions
+    unsigned long long run_ns;      // schedstat: on the CPU
+    unsigned long long wait_ns;     // ... runnable, waiting for it
+    unsigned long long timeslices;  // ... times run on a CPU
+} ThreadStat;
+
+// name the calling thread (up to 15 characters, truncated)
+void set_thread_name(const char *name);
+
+/*
+    Name the calling thread for the lifetime of the object: the threads it
+    creates meanwhile, e.g. a library's, inherit the name. Not for the
+    main thread: its name is the process's, as in /proc/PID/comm
+*/
+class ThreadNameScope
+{
+    char saved[THREAD_NAME_SZ] = "";
+
+public:
+    ThreadNameScope(const char *name);
+    ~ThreadNameScope();
+};
+
+// the threads of a process (0: this one); empty if it is gone
+std::vector<ThreadStat> thread_stats(pid_t pid = 0);
+// the subsystem of a thread, by its name; the main thread's is the process's
+const char *thread_subsystem(const std::string& name, bool main_thread);
+std::string thread_report(const std::vector<ThreadStat>& threads);
+std::string thread_report_json(pid_t pid, const std::vector<ThreadStat>& threads);
+
+#endif
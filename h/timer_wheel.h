@@ -0,0 +1,33 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <functional>
+
+// Hashed timer wheel: timers are kept in the slot of their expiry tick,
+// with the number of wheel rounds left. Not thread-safe; advanced by its
+// owner's thread, and the callbacks run on it.
+class TimerWheel {
+public:
+    typedef std::function<void()> Callback;
+
+    TimerWheel(unsigned tick_ms, unsigned slots, unsigned long long now_ms);
+    void schedule(unsigned delay_ms, Callback callback);
+    void advance(unsigned long long now_ms);    // run the expired timers
+    void expire_all();                          // run all the pending ones
+    size_t pending() const { return count; }
+    unsigned tick() const { return tick_ms; }
+
+private:
+    struct Timer {
+        unsigned long long rounds;
+        Callback callback;
+    };
+    std::vector<std::vector<Timer>> wheel;
+    unsigned tick_ms;
+    unsigned long long origin_ms;
+    unsigned long long current = 0;             // ticks since origin
+    size_t count = 0;
+};
+
+#endif
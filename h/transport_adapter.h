@@ -0,0 +1,221 @@
+#ifndef TRANSPORT_ADAPTER_H
+#define TRANSPORT_ADAPTER_H
+
+#include <pjmedia.h>
+#include <pjmedia/transport_srtp.h>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <memory>
+#include "impairment.h"
+
+#define TS_TX_RING  64              // sent packets awaiting their kernel timestamp
+#define OWD_EXT_ID  1               // RFC 8285 one-byte header extension: the send time
+#define OWD_BUCKETS 12
+#define SRTP_MAX_TRAILER    32      // SRTP(C) auth tag, SRTCP index, MKI
+#define IMPAIR_HOLD_MS      200     // a reordered packet, if no other one follows
+#define IMPAIR_SLOTS        256     // delayed packets: 2.5 s at 20 ms, 1 s with duplicates
+
+enum kernel_ts_mode {
+    kts_off = 0,
+    kts_rx,             // SIOCGSTAMPNS, of each received packet
+    kts_tx,             // SO_TIMESTAMPING, sent packets (exclusive of kts_rx)
+};
+
+// Statistics of the packets' kernel (software) timestamps, in usec
+typedef struct KernelTsStat_t {
+    pj_math_stat rx_jitter;         // RFC 3550 interarrival jitter, of the kernel RX times
+    pj_math_stat rx_interarrival;
+    pj_math_stat rx_host_delay;     // from kernel RX to the stream: host processing delay
+    pj_math_stat tx_jitter;         // the same jitter, of the kernel TX times: the pacing
+    pj_math_stat tx_host_delay;     // from the send call to kernel TX
+} KernelTsStat;
+
+// One-way delay of the received packets, from their send time (NTP, RFC
+// 6051 format) in a header extension, in usec; the hosts' clocks synced
+typedef struct OwdStat_t {
+    pj_math_stat owd;
+    unsigned hist[OWD_BUCKETS];     // per bucket of owd_bucket_us
+} OwdStat;
+
+// the histogram buckets' upper bounds, in usec; the first one holds the
+// negative delays (clocks out of sync), the last one is open
+extern const int owd_bucket_us[OWD_BUCKETS];
+// the bucket bound under which pct % of the delays are, -1 if none
+int owd_percentile(const OwdStat *stat, unsigned pct);
+
+// SRTP protect/unprotect of the stream's RTP and RTCP packets: their
+// count and CPU time, since the SRTP transport's creation
+typedef struct SrtpStat_t {
+    unsigned long protect_pkts;
+    unsigned long long protect_ns;
+    unsigned long unprotect_pkts;
+    unsigned long long unprotect_ns;
+    unsigned long unprotect_fail;   // failed authentication or replay check; dropped
+} SrtpStat;
+
+/*
+    Media transport, stacked between a pjmedia stream and its UDP transport.
+    The stream stays attached to the adapter for its whole life, while the
+    adapter can re-attach the UDP transport to a new remote address. This
+    allows an endpoint to be retargeted to a new call, without re-creating
+    the stream.
+*/
+class TransportAdapter
+{
+    pjmedia_transport base;         // must be first; pjmedia casts it back
+    pjmedia_transport *slave;       // the underlying (UDP) transport
+
+    /* the attached stream */
+    void *stream_ref;
+    void *stream_user_data;
+    void (*stream_rtp_cb)(void *user_data, void *pkt, pj_ssize_t size);
+    void (*stream_rtp_cb2)(pjmedia_tp_cb_param *param);
+    void (*stream_rtcp_cb)(void *user_data, void *pkt, pj_ssize_t size);
+
+    /* outgoing RTP/RTCP rewriting, after a retarget */
+    bool rewrite;
+    pj_uint32_t stream_ssrc;
+    pj_uint32_t tx_ssrc;
+    pj_uint16_t seq_offset;
+    pj_uint32_t ts_offset;
+    pj_uint8_t tx_buf[PJMEDIA_MAX_MTU + SRTP_MAX_TRAILER];
+    pj_uint8_t rtcp_buf[PJMEDIA_MAX_MTU + SRTP_MAX_TRAILER];    // RTCP is sent from the ioqueue, RTP from the clock
+
+    /* one-way delay: send time header extension, 0 if off */
+    int owd_id;
+
+    std::atomic<pj_uint64_t> first_pkt_ns;  // CLOCK_MONOTONIC; 0 until then
+    void (*first_pkt_cb)(void *);           // called once, from the media threads
+    void *first_pkt_arg;
+    void first_packet();
+
+    /* SRTP: protected after the rewriting, unprotected before the stream */
+    pjmedia_transport *srtp;        // its crypto only, over the slave
+    bool srtp_on;
+    std::mutex srtp_mutex;          // the stats
+    SrtpStat srtp_stat;
+    pj_status_t protect(pj_uint8_t *pkt, pj_size_t *size, bool is_rtp);
+    bool unprotect(void *pkt, pj_ssize_t *size, bool is_rtp);
+
+    /* impairment of the sent RTP packets, as they go out (after SRTP); the
+       delayed ones are queued by due time, and sent by their own thread */
+    struct DelaySlot {
+        pj_uint64_t due;            // CLOCK_MONOTONIC ns
+        pj_size_t size;
+        pj_uint8_t pkt[PJMEDIA_MAX_MTU + SRTP_MAX_TRAILER];
+    };
+    bool impair_on;
+    bool impair_delay;              // jitter or reorder: through the queue
+    Impairer impairer;
+    ImpairStat impair_stat;
+    std::mutex impair_mutex;        // the draws, the queue and the stats
+    std::condition_variable impair_cv;
+    std::unique_ptr<DelaySlot[]> delayed;   // a ring of IMPAIR_SLOTS, by due time
+    unsigned delayed_head;          // the next one due
+    unsigned delayed_count;
+    DelaySlot held;                 // the reordered packet, until the next one
+    bool holding;
+    pj_uint64_t last_due;           // jitter keeps the order
+    std::thread impair_thread;
+    bool impair_stop;
+    pj_status_t impair(const pj_uint8_t *pkt, pj_size_t size);
+    void delay(const pj_uint8_t *pkt, pj_size_t size, pj_uint64_t due);
+    void impair_sender();
+    pj_status_t send_out(const void *pkt, pj_size_t size);
+
+    /* kernel timestamps */
+    struct TsFlow {
+        bool valid;
+        pj_uint32_t ssrc;
+        pj_uint32_t rtp_ts;
+        pj_uint64_t kernel_ns;
+        double jitter;              // in timestamp units
+    };
+    struct TxRecord {
+        pj_uint64_t user_ns;
+        pj_uint32_t rtp_ts;
+        pj_uint32_t ssrc;
+    };
+    int ts_mode;
+    pj_sock_t ts_sock;
+    unsigned clock_rate;
+    std::mutex ts_mutex;            // the stats, between the RX, TX and reporting threads
+    KernelTsStat ts_stat;
+    OwdStat owd_stat;
+    TsFlow rx_flow;
+    TsFlow tx_flow;
+    pj_uint32_t tx_id;              // of the next packet sent, as the kernel counts them
+    TxRecord tx_ring[TS_TX_RING];
+
+    TransportAdapter(pjmedia_transport *slave);
+    pj_status_t attach_slave(pjmedia_transport_attach_param *att_param);
+    void rewrite_rtcp(pj_uint8_t *pkt, pj_size_t size);
+    void reset_ts_stat();
+    void ts_update(TsFlow &flow, pj_math_stat &jitter, pj_math_stat *interarrival,
+                   pj_uint64_t kernel_ns, pj_uint32_t rtp_ts, pj_uint32_t ssrc);
+    void ts_received(const void *pkt, pj_ssize_t size);
+    void ts_sent(const void *pkt, pj_size_t size);
+    pj_size_t add_send_time(const pj_uint8_t *pkt, pj_size_t size);
+    void owd_received(const void *pkt, pj_ssize_t size);
+
+    static TransportAdapter *from(pjmedia_transport *tp);
+    static void rtp_cb2(pjmedia_tp_cb_param *param);
+    static void rtcp_cb(void *user_data, void *pkt, pj_ssize_t size);
+
+    /* pjmedia_transport_op */
+    static pj_status_t get_info(pjmedia_transport *tp, pjmedia_transport_info *info);
+    static pj_status_t attach(pjmedia_transport *tp, void *user_data,
+                              const pj_sockaddr_t *rem_addr, const pj_sockaddr_t *rem_rtcp,
+                              unsigned addr_len,
+                              void (*rtp_cb)(void *, void *, pj_ssize_t),
+                              void (*rtcp_cb)(void *, void *, pj_ssize_t));
+    static pj_status_t attach2(pjmedia_transport *tp, pjmedia_transport_attach_param *att_param);
+    static void detach(pjmedia_transport *tp, void *user_data);
+    static pj_status_t send_rtp(pjmedia_transport *tp, const void *pkt, pj_size_t size);
+    static pj_status_t send_rtcp(pjmedia_transport *tp, const void *pkt, pj_size_t size);
+    static pj_status_t send_rtcp2(pjmedia_transport *tp, const pj_sockaddr_t *addr,
+                                  unsigned addr_len, const void *pkt, pj_size_t size);
+    static pj_status_t media_create(pjmedia_transport *tp, pj_pool_t *sdp_pool, unsigned options,
+                                    const pjmedia_sdp_session *rem_sdp, unsigned media_index);
+    static pj_status_t encode_sdp(pjmedia_transport *tp, pj_pool_t *sdp_pool,
+                                  pjmedia_sdp_session *local_sdp,
+                                  const pjmedia_sdp_session *rem_sdp, unsigned media_index);
+    static pj_status_t media_start(pjmedia_transport *tp, pj_pool_t *pool,
+                                   const pjmedia_sdp_session *local_sdp,
+                                   const pjmedia_sdp_session *rem_sdp, unsigned media_index);
+    static pj_status_t media_stop(pjmedia_transport *tp);
+    static pj_status_t simulate_lost(pjmedia_transport *tp, pjmedia_dir dir, unsigned pct_lost);
+    static pj_status_t destroy(pjmedia_transport *tp);
+
+public:
+    // the adapter owns slave; it is closed along with the adapter
+    static pj_status_t create(pjmedia_transport *slave, pjmedia_transport **p_tp);
+    static pj_status_t retarget(pjmedia_transport *tp, const pj_sockaddr_in *rem_addr,
+                                const pj_sockaddr_in *rem_rtcp, pj_uint32_t stream_ssrc,
+                                pj_uint32_t new_ssrc);
+    // kernel timestamps of the RTP packets, received or sent
+    static pj_status_t set_timestamping(pjmedia_transport *tp, kernel_ts_mode mode,
+                                        unsigned clock_rate);
+    static void get_timestamp_stat(pjmedia_transport *tp, KernelTsStat *stat, bool reset);
+    // one-way delay: the sent packets stamped (ext_id 1-14; 0: off), and
+    // the received ones' delay measured, when stamped by the peer
+    static void set_owd(pjmedia_transport *tp, int ext_id);
+    static void get_owd_stat(pjmedia_transport *tp, OwdStat *stat, bool reset);
+    // SRTP, with the same master key and salt both ways; suite NULL: off
+    static pj_status_t set_srtp(pjmedia_transport *tp, pjmedia_endpt *endpt, const char *suite,
+                                const pj_str_t *key);
+    static void get_srtp_stat(pjmedia_transport *tp, SrtpStat *stat);
+    // the sent RTP packets lost, delayed, reordered or duplicated, as of
+    // profile (none: all 0); the stats are cumulative
+    static void set_impairment(pjmedia_transport *tp, const ImpairProfile *profile);
+    static void get_impair_stat(pjmedia_transport *tp, ImpairStat *stat);
+    // when the first RTP packet was sent or received (CLOCK_MONOTONIC, ns); 0 if none yet
+    static pj_uint64_t first_packet_time(pjmedia_transport *tp);
+    // cb(arg) called at the first RTP packet, from the thread sending or
+    // receiving it: not to block; set before the stream starts
+    static void on_first_packet(pjmedia_transport *tp, void (*cb)(void *), void *arg);
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include "call_plan.h"
+#include "thread_stats.h"
+
+#define PLAN_TICK_MS    10
+#define PLAN_SLOTS      1024            // a round of ~10s
+
+using namespace std::chrono;
+
+static unsigned long long now_ms()
+{
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+CallPlan::~CallPlan()
+{
+    stop();
+}
+
+bool CallPlan::start(const PlanConfig& config, const PlanActions& actions)
+{
+    // one plan at a time, against concurrent POST /plan
+    std::lock_guard<std::mutex> lock(m);
+    if (running)
+        return false;
+    if (thread.joinable())
+        thread.join();
+
+    this->config = config;
+    this->actions = actions;
+    next_timepoint = 0;
+    next_port = config.port_first;
+    next_target = 0;
+    dest_ports.clear();
+    for (const PlanTarget& target : config.targets)
+        dest_ports.push_back(target.port_first);
+    calls = rejected = blocked = ended = 0;
+    finished = false;
+    stopping = false;
+    started = steady_clock::now();
+    running = true;
+    thread = std::thread(&CallPlan::run, this);
+    return true;
+}
+
+void CallPlan::stop()
+{
+    std::lock_guard<std::mutex> lock(m);
+    stopping = true;
+    if (thread.joinable())
+        thread.join();
+}
+
+void CallPlan::run()
+{
+    set_thread_name("ms-plan");
+    TimerWheel timer_wheel(PLAN_TICK_MS, PLAN_SLOTS, now_ms());
+    wheel = &timer_wheel;
+
+    // the first call right away, as SIPp does
+    set_cps(config.cps);
+    if (config.cps > 0)
+        start_call();
+    schedule_timepoint();
+    if (config.duration)
+        wheel->schedule(config.duration, [this] { finished = true; });
+
+    // until stopped, or the plan's calls are all over
+    while (!stopping && !(finished && !wheel->pending())) {
+        std::this_thread::sleep_for(milliseconds(PLAN_TICK_MS));
+        wheel->advance(now_ms());
+    }
+
+    // end the calls still running
+    finished = true;
+    wheel->expire_all();
+    wheel = nullptr;
+    cps_now = 0;
+    running = false;
+}
+
+void CallPlan::set_cps(double cps)
+{
+    current_cps = cps;
+    cps_now = cps;
+    credit = 0;
+    last_fire = steady_clock::now();
+    generation++;
+    if (cps > 0)
+        schedule_call(generation);
+}
+
+// Calls are started in batches, on ticks, when cps is above the tick rate
+void CallPlan::schedule_call(unsigned gen)
+{
+    unsigned interval = std::max((unsigned)(1000 / current_cps), wheel->tick());
+    wheel->schedule(interval, [this, gen] {
+        if (gen != generation || finished)
+            return;
+        steady_clock::time_point now = steady_clock::now();
+        credit += current_cps * duration<double>(now - last_fire).count();
+        last_fire = now;
+        for (; credit >= 1 && !finished; credit--)
+            start_call();
+        schedule_call(gen);
+    });
+}
+
+// the cps change at the next timepoint
+void CallPlan::schedule_timepoint()
+{
+    if (config.timepoints.empty())
+        return;
+    if (next_timepoint == config.timepoints.size()) {
+        if (!config.repeat)
+            return;
+        next_timepoint = 0;
+    }
+    size_t i = next_timepoint++;
+    wheel->schedule(config.timepoints[i], [this, i] {
+        if (finished)
+            return;
+        set_cps(config.pattern[i]);
+        schedule_timepoint();
+    });
+}
+
+void CallPlan::start_call()
+{
+    if (config.total_calls && calls >= config.total_calls) {
+        finished = true;
+        return;
+    }
+
+    // the next local port without an active endpoint; RTP ports are even,
+    // the next ones being RTCP's
+    int port = 0;
+    for (int i = config.port_first; i <= config.port_last; i += 2) {
+        int candidate = next_port;
+        next_port = (next_port + 2 > config.port_last)? config.port_first : next_port + 2;
+        if (actions.port_free(candidate)) {
+            port = candidate;
+            break;
+        }
+    }
+    if (!port) {
+        blocked++;
+        return;
+    }
+
+    // the targets in turn, and each one's ports in turn
+    Data data = {};
+    data.port = port;
+    data.client = config.client;
+    data.bidir = config.bidir;
+    data.duration = config.call_duration;
+    data.ptime = config.ptime;
+    data.dtx = config.dtx;
+    const PlanTarget& target = config.targets[next_target];
+    strncpy(data.dest_address, target.address.c_str(), ADDR_SZ - 1);
+    int &dest_port = dest_ports[next_target];
+    data.dest_port = dest_port;
+    dest_port = (dest_port + 2 > target.port_last)? target.port_first : dest_port + 2;
+    next_target = (next_target + 1) % config.targets.size();
+
+    if (!actions.start_call(data)) {
+        rejected++;
+        return;
+    }
+    calls++;
+
+    // the clients end by themselves, after their duration
+    wheel->schedule(config.call_duration, [this, port] {
+        if (!config.client)
+            actions.end_call(port);
+        ended++;
+    });
+}
+
+std::string CallPlan::status() const
+{
+    char cps[16];
+    snprintf(cps, sizeof(cps), "%.2f", cps_now.load());
+    std::lock_guard<std::mutex> lock(m);
+    long long elapsed = (running)?
+        duration_cast<milliseconds>(steady_clock::now() - started).count() : 0;
+    return
+        std::string("plan: ") + ((running)? (finished)? "ending calls" : "running" : "idle") + "\n" +
+        "elapsed (ms): " + std::to_string(elapsed) + "\n" +
+        "cps: " + cps + "\n" +
+        "calls started: " + std::to_string(calls) + "\n" +
+        "calls ended: " + std::to_string(ended) + "\n" +
+        "calls rejected: " + std::to_string(rejected) + "\n" +
+        "calls blocked (no free port): " + std::to_string(blocked) + "\n";
+}
+
+bool CallPlan::parse_time(const std::string& time_sign, unsigned *ms)
+{
+    const char *p = time_sign.c_str();
+    if (!*p)
+        return false;
+
+    unsigned long long total = 0;
+    while (*p) {
+        char *end;
+        unsigned long long n = strtoull(p, &end, 10);
+        if (end == p)
+            return false;
+        p = end;
+        if (!*p)
+            total += n * 1000;              // seconds, by default
+        else if (!strncmp(p, "ms", 2)) {
+            total += n;
+            p += 2;
+        } else if (*p == 'h' || *p == 'm' || *p == 's') {
+            total += n * ((*p == 'h')? 3600000 : (*p == 'm')? 60000 : 1000);
+            p++;
+        } else
+            return false;
+    }
+    *ms = total;
+    return true;
+}
+
+bool CallPlan::parse_range(const std::string& range, int *first, int *last)
+{
+    char *end;
+    long a = strtol(range.c_str(), &end, 10);
+    long b = a;
+    if (*end == '-')
+        b = strtol(end + 1, &end, 10);
+    if (*end || a <= 0 || b < a || b > 65535)
+        return false;
+    *first = a;
+    *last = b;
+    return true;
+}
+
+bool CallPlan::parse_targets(const std::string& targets, std::vector<PlanTarget>& out)
+{
+    size_t start = 0;
+    while (start < targets.length()) {
+        size_t end = targets.find(',', start);
+        if (end == std::string::npos)
+            end = targets.length();
+        std::string target = targets.substr(start, end - start);
+        size_t colon = target.find(':');
+        PlanTarget t;
+        if (colon == std::string::npos || colon == 0 || colon >= ADDR_SZ ||
+            !parse_range(target.substr(colon + 1), &t.port_first, &t.port_last))
+            return false;
+        t.address = target.substr(0, colon);
+        out.push_back(t);
+        start = end + 1;
+    }
+    return !out.empty();
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cgroup.h"
+
+#define CPU_PERIOD 100000       // cpu.max period (usec)
+
+// from the "0::/path" line of /proc/self/cgroup
+Cgroup Cgroup::self()
+{
+    char line[512];
+    std::string path;
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (!f)
+        return Cgroup();
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "0::", 3))
+            continue;
+        line[strcspn(line, "\n")] = 0;
+        path = std::string(CGROUP_ROOT) + (line + 3);
+        break;
+    }
+    fclose(f);
+    return Cgroup(path);
+}
+
+bool Cgroup::write(const char* file, const std::string& value) const
+{
+    std::string file_path = path + "/" + file;
+    int fd = open(file_path.c_str(), O_WRONLY);
+    if (fd == -1)
+        return false;
+    bool ok = (::write(fd, value.c_str(), value.length()) == (ssize_t)value.length());
+    close(fd);
+    return ok;
+}
+
+Cgroup Cgroup::child(const std::string& name) const
+{
+    if (!valid())
+        return Cgroup();
+    std::string child_path = path + "/" + name;
+    if (mkdir(child_path.c_str(), 0755) == -1 && errno != EEXIST)
+        return Cgroup();
+    return Cgroup(child_path);
+}
+
+bool Cgroup::remove() const
+{
+    return valid() && rmdir(path.c_str()) == 0;
+}
+
+// e.g. "+cpu +memory"; for the child cgroups
+bool Cgroup::enable_controllers(const std::string& controllers) const
+{
+    return write("cgroup.subtree_control", controllers);
+}
+
+bool Cgroup::attach(pid_t pid) const
+{
+    return write("cgroup.procs", std::to_string(pid));
+}
+
+int Cgroup::open_procs() const
+{
+    if (!valid())
+        return -1;
+    return open((path + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+}
+
+bool Cgroup::set_cpu_limit(double cpus) const
+{
+    return write("cpu.max", std::to_string((long)(cpus * CPU_PERIOD)) + " " +
+                 std::to_string(CPU_PERIOD));
+}
+
+bool Cgroup::set_memory_limit(unsigned long long bytes) const
+{
+    return write("memory.max", std::to_string(bytes));
+}
+
+CgroupUsage Cgroup::usage() const
+{
+    CgroupUsage usage = {};
+    char line[128];
+
+    FILE *f = fopen((path + "/cpu.stat").c_str(), "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            sscanf(line, "usage_usec %llu", &usage.cpu_usec);
+            sscanf(line, "user_usec %llu", &usage.user_usec);
+            sscanf(line, "system_usec %llu", &usage.system_usec);
+            sscanf(line, "nr_throttled %llu", &usage.nr_throttled);
+            sscanf(line, "throttled_usec %llu", &usage.throttled_usec);
+        }
+        fclose(f);
+    }
+
+    f = fopen((path + "/memory.current").c_str(), "r");
+    if (f) {
+        if (fscanf(f, "%llu", &usage.memory) != 1)
+            usage.memory = 0;
+        fclose(f);
+    }
+    return usage;
+}
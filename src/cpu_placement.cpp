@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <algorithm>
+#include "cpu_placement.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+
+bool CpuPlacement::parse_cpu_list(const std::string& cpu_list, std::vector<int>& cpus)
+{
+    const char *p = cpu_list.c_str();
+    while (*p) {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+        if (*p == ',')
+            p++;
+        else if (*p && *p != '\n')
+            return false;
+        else
+            break;
+    }
+    return !cpus.empty();
+}
+
+// the NUMA node of a CPU; 0 if not a NUMA system
+int CpuPlacement::numa_node(int cpu)
+{
+    DIR *dir = opendir(NODE_DIR);
+    if (!dir)
+        return 0;
+
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        int n;
+        if (sscanf(entry->d_name, "node%d", &n) != 1)
+            continue;
+        std::string path = std::string(NODE_DIR "/") + entry->d_name + "/cpulist";
+        char line[256];
+        FILE *f = fopen(path.c_str(), "r");
+        if (!f)
+            continue;
+        std::vector<int> node_cpus;
+        if (fgets(line, sizeof(line), f) && parse_cpu_list(line, node_cpus) &&
+            std::find(node_cpus.begin(), node_cpus.end(), cpu) != node_cpus.end())
+            node = n;
+        fclose(f);
+    }
+    closedir(dir);
+    return node;
+}
+
+std::vector<int> CpuPlacement::numa_nodes(const std::vector<int>& cpus)
+{
+    std::vector<int> nodes;
+    for (int cpu : cpus)
+        nodes.push_back(numa_node(cpu));
+    return nodes;
+}
+
+bool CpuPlacement::configure(const std::string& cpu_list, bool numa_spread)
+{
+    std::vector<int> set;
+    if (!parse_cpu_list(cpu_list, set))
+        return false;
+
+    if (!numa_spread) {
+        cpus = set;
+        return true;
+    }
+
+    // interleave the nodes: 1st CPU of each node, then 2nd of each node, ...
+    std::vector<int> nodes = numa_nodes(set);
+    std::vector<std::vector<int>> per_node(*std::max_element(nodes.begin(), nodes.end()) + 1);
+    for (size_t i = 0; i < set.size(); i++)
+        per_node[nodes[i]].push_back(set[i]);
+
+    cpus.clear();
+    for (size_t i = 0; cpus.size() < set.size(); i++)
+        for (auto& node_cpus : per_node)
+            if (i < node_cpus.size())
+                cpus.push_back(node_cpus[i]);
+    return true;
+}
+
+int CpuPlacement::next_cpu()
+{
+    if (cpus.empty())
+        return -1;
+    int cpu = cpus[next];
+    next = (next + 1) % cpus.size();
+    return cpu;
+}
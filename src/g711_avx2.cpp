@@ -0,0 +1,46 @@
+// G.711 kernels for AVX2; built with -mavx2, used if the CPU has it
+#include <immintrin.h>
+#include "g711_kernel.h"
+
+struct VAvx2 {
+    typedef __m256i reg;
+    static const size_t lanes = 16;
+
+    static reg load_pcm(const int16_t *p) { return _mm256_loadu_si256((const __m256i*)p); }
+    static void store_pcm(int16_t *p, reg x) { _mm256_storeu_si256((__m256i*)p, x); }
+    static reg load_bytes(const uint8_t *p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p)); }
+    static void store_bytes(uint8_t *p, reg x) {
+        // packed per 128-bit lane: gather the 1st and 3rd quadwords
+        reg packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(x, x), 0x08);
+        _mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(packed));
+    }
+    static reg zero() { return _mm256_setzero_si256(); }
+    static reg set1(int v) { return _mm256_set1_epi16((short)v); }
+    static reg add(reg a, reg b) { return _mm256_add_epi16(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_epi16(a, b); }
+    static reg subs_epu16(reg a, reg b) { return _mm256_subs_epu16(a, b); }
+    static reg and_(reg a, reg b) { return _mm256_and_si256(a, b); }
+    static reg andnot(reg a, reg b) { return _mm256_andnot_si256(a, b); }
+    static reg or_(reg a, reg b) { return _mm256_or_si256(a, b); }
+    static reg xor_(reg a, reg b) { return _mm256_xor_si256(a, b); }
+    static reg cmpgt(reg a, reg b) { return _mm256_cmpgt_epi16(a, b); }
+    static reg cmpeq(reg a, reg b) { return _mm256_cmpeq_epi16(a, b); }
+    static reg abs(reg a) { return _mm256_abs_epi16(a); }
+    static reg min_epu16(reg a, reg b) { return _mm256_min_epu16(a, b); }
+    static reg max_epi16(reg a, reg b) { return _mm256_max_epi16(a, b); }
+    static reg mullo(reg a, reg b) { return _mm256_mullo_epi16(a, b); }
+    static reg mulhi_epu16(reg a, reg b) { return _mm256_mulhi_epu16(a, b); }
+    template<int N> static reg slli(reg a) { return _mm256_slli_epi16(a, N); }
+    template<int N> static reg srli(reg a) { return _mm256_srli_epi16(a, N); }
+    // 2^n, n in [0, 7]
+    static reg pow2(reg n) {
+        const reg table = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                           1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+        return _mm256_shuffle_epi8(table, _mm256_or_si256(n, set1(0x8000)));
+    }
+};
+
+extern const G711Kernels g711_avx2_kernels[2] = {
+    {g711_encode_vector<VAvx2, g711_ulaw>, g711_decode_vector<VAvx2, g711_ulaw>, "avx2"},
+    {g711_encode_vector<VAvx2, g711_alaw>, g711_decode_vector<VAvx2, g711_alaw>, "avx2"},
+};
@@ -0,0 +1,109 @@
+// Microbenchmark of the G.711 kernels against pjmedia's own G.711:
+// samples/sec per law, after a check that they are bit-exact with it.
+// Usage: g711_bench [SECONDS_PER_RUN]
+#include <pjmedia.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "g711_simd.h"
+
+#define FRAME       160             // 20 ms, as sent
+#define BUF_FRAMES  512             // ~160KB of PCM, in the L2 cache
+
+using namespace std::chrono;
+
+static double run_seconds = 1;
+static volatile uint8_t sink;
+
+// samples/sec of a kernel, run over the buffers frame by frame
+template<class F> static double measure(F kernel)
+{
+    unsigned long long samples = 0;
+    steady_clock::time_point start = steady_clock::now();
+    double elapsed;
+    do {
+        for (int i = 0; i < 100; i++)
+            for (size_t f = 0; f < BUF_FRAMES; f++)
+                kernel(f * FRAME);
+        samples += 100ULL * BUF_FRAMES * FRAME;
+        elapsed = duration<double>(steady_clock::now() - start).count();
+    } while (elapsed < run_seconds);
+    return samples / elapsed;
+}
+
+static void pj_encode(g711_law law, uint8_t *dst, const int16_t *src, size_t n)
+{
+    if (law == g711_ulaw)
+        pjmedia_ulaw_encode(dst, src, n);
+    else
+        pjmedia_alaw_encode(dst, src, n);
+}
+
+static void pj_decode(g711_law law, int16_t *dst, const uint8_t *src, size_t n)
+{
+    if (law == g711_ulaw)
+        pjmedia_ulaw_decode(dst, src, n);
+    else
+        pjmedia_alaw_decode(dst, src, n);
+}
+
+// over all 65536 samples, and all 256 codes
+static bool bit_exact(g711_law law, const G711Kernels *k)
+{
+    std::vector<int16_t> pcm(65536), pcm_ref(256), pcm_out(256);
+    std::vector<uint8_t> ref(65536), out(65536), codes(256);
+    for (int i = 0; i < 65536; i++)
+        pcm[i] = (int16_t)(i - 32768);
+    for (int i = 0; i < 256; i++)
+        codes[i] = i;
+
+    pj_encode(law, ref.data(), pcm.data(), pcm.size());
+    k->encode(pcm.data(), out.data(), pcm.size());
+    pj_decode(law, pcm_ref.data(), codes.data(), codes.size());
+    k->decode(codes.data(), pcm_out.data(), codes.size());
+    return ref == out && pcm_ref == pcm_out;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        run_seconds = atof(argv[1]);
+
+    // a sweep of amplitudes, so that all segments are used
+    std::vector<int16_t> pcm(BUF_FRAMES * FRAME), pcm_out(pcm.size());
+    std::vector<uint8_t> coded(pcm.size());
+    for (size_t i = 0; i < pcm.size(); i++)
+        pcm[i] = (int16_t)((rand() % 65536) - 32768) >> (i % 12);
+
+    static const g711_isa isas[] = {isa_scalar, isa_sse41, isa_avx2};
+    for (g711_law law : {g711_ulaw, g711_alaw}) {
+        const char *name = (law == g711_ulaw)? "PCMU" : "PCMA";
+        printf("%s (Msamples/s)      encode     decode\n", name);
+
+        double enc = measure([&](size_t off) {
+            pj_encode(law, coded.data() + off, pcm.data() + off, FRAME); });
+        double dec = measure([&](size_t off) {
+            pj_decode(law, pcm_out.data() + off, coded.data() + off, FRAME); });
+        printf("  %-16s %10.1f %10.1f\n", "pjmedia", enc / 1e6, dec / 1e6);
+        double pj_enc = enc, pj_dec = dec;
+
+        for (g711_isa isa : isas) {
+            const G711Kernels *k = g711_kernels(law, isa);
+            if (!k)
+                continue;
+            if (!bit_exact(law, k)) {
+                printf("  %-16s NOT bit-exact with pjmedia\n", k->isa);
+                return 1;
+            }
+            enc = measure([&](size_t off) {
+                k->encode(pcm.data() + off, coded.data() + off, FRAME); });
+            dec = measure([&](size_t off) {
+                k->decode(coded.data() + off, pcm_out.data() + off, FRAME); });
+            printf("  %-16s %10.1f %10.1f   (x%.1f, x%.1f)\n", k->isa,
+                   enc / 1e6, dec / 1e6, enc / pj_enc, dec / pj_dec);
+        }
+        sink = coded[rand() % coded.size()] ^ (uint8_t)pcm_out[rand() % pcm_out.size()];
+    }
+    return 0;
+}
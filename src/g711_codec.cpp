@@ -0,0 +1,279 @@
+#include "g711_codec.h"
+#include "logger.h"
+#include <new>
+
+#define CLOCK_RATE          8000
+#define PTIME               10      // ms, per frame
+#define SAMPLES_PER_FRAME   (CLOCK_RATE * PTIME / 1000)
+#define FRAME_SIZE          SAMPLES_PER_FRAME   // one byte per sample
+
+static pjmedia_codec_factory_op factory_op;
+static pjmedia_codec_op codec_op;
+
+static struct G711Factory {
+    pjmedia_codec_factory base;
+    pjmedia_endpt *endpt;
+    pj_pool_t *pool;
+    pjmedia_codec codec_list;       // the deallocated codecs, for reuse
+    int only_pt;                    // the single codec registered; -1: both
+} factory;
+
+static const struct { unsigned pt; const char *name; } g711[] = {
+    {PJMEDIA_RTP_PT_PCMU, "PCMU"},
+    {PJMEDIA_RTP_PT_PCMA, "PCMA"},
+};
+
+G711Codec *G711Codec::from(pjmedia_codec *codec)
+{
+    return reinterpret_cast<G711Codec *>(codec);
+}
+
+pj_status_t G711Codec::register_factory(pjmedia_endpt *endpt, const char *codec_id)
+{
+    if (factory.pool)
+        return PJ_SUCCESS;
+
+    factory.only_pt = -1;
+    for (unsigned i = 0; codec_id && *codec_id && i < PJ_ARRAY_SIZE(g711); i++)
+        if (pj_ansi_strnicmp(codec_id, g711[i].name, 4) == 0)
+            factory.only_pt = g711[i].pt;
+
+    if (!factory_op.test_alloc) {
+        factory_op.test_alloc = &test_alloc;
+        factory_op.default_attr = &default_attr;
+        factory_op.enum_info = &enum_info;
+        factory_op.alloc_codec = &alloc_codec;
+        factory_op.dealloc_codec = &dealloc_codec;
+        factory_op.destroy = &destroy_factory;
+
+        codec_op.init = &init;
+        codec_op.open = &open;
+        codec_op.close = &close;
+        codec_op.modify = &modify;
+        codec_op.parse = &parse;
+        codec_op.encode = &encode;
+        codec_op.decode = &decode;
+        codec_op.recover = &recover;
+    }
+
+    factory.base.op = &factory_op;
+    factory.endpt = endpt;
+    factory.pool = pjmedia_endpt_create_pool(endpt, "g711simd", 4000, 4000);
+    if (!factory.pool)
+        return PJ_ENOMEM;
+    pj_list_init(&factory.codec_list);
+
+    pj_status_t status = pjmedia_codec_mgr_register_factory(
+        pjmedia_endpt_get_codec_mgr(endpt), &factory.base);
+    if (status != PJ_SUCCESS) {
+        pj_pool_release(factory.pool);
+        factory.pool = NULL;
+        return status;
+    }
+    LOG(log_debug, "G.711 codecs on %s kernels", g711_kernels(g711_ulaw)->isa);
+    return PJ_SUCCESS;
+}
+
+// on the codec manager's destruction
+pj_status_t G711Codec::destroy_factory(void)
+{
+    if (!factory.pool)
+        return PJ_SUCCESS;
+    pjmedia_codec_mgr_unregister_factory(pjmedia_endpt_get_codec_mgr(factory.endpt),
+                                         &factory.base);
+    pj_pool_release(factory.pool);
+    factory.pool = NULL;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::test_alloc(pjmedia_codec_factory *, const pjmedia_codec_info *info)
+{
+    if ((info->pt == PJMEDIA_RTP_PT_PCMU || info->pt == PJMEDIA_RTP_PT_PCMA) &&
+        (factory.only_pt < 0 || info->pt == (unsigned)factory.only_pt))
+        return PJ_SUCCESS;
+    return PJMEDIA_CODEC_EUNSUP;
+}
+
+pj_status_t G711Codec::default_attr(pjmedia_codec_factory *, const pjmedia_codec_info *info,
+                                    pjmedia_codec_param *attr)
+{
+    pj_bzero(attr, sizeof(pjmedia_codec_param));
+    attr->info.clock_rate = CLOCK_RATE;
+    attr->info.channel_cnt = 1;
+    attr->info.avg_bps = 64000;
+    attr->info.max_bps = 64000;
+    attr->info.pcm_bits_per_sample = 16;
+    attr->info.frm_ptime = PTIME;
+    attr->info.pt = (pj_uint8_t)info->pt;
+
+    /* as pjmedia's: 20 ms packets, PLC and VAD */
+    attr->setting.frm_per_pkt = 2;
+    attr->setting.plc = 1;
+    attr->setting.vad = 1;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::enum_info(pjmedia_codec_factory *, unsigned *count,
+                                 pjmedia_codec_info codecs[])
+{
+    unsigned n = 0;
+    for (unsigned i = 0; n < *count && i < PJ_ARRAY_SIZE(g711); i++) {
+        if (factory.only_pt >= 0 && g711[i].pt != (unsigned)factory.only_pt)
+            continue;
+        pj_bzero(&codecs[n], sizeof(pjmedia_codec_info));
+        codecs[n].type = PJMEDIA_TYPE_AUDIO;
+        codecs[n].pt = g711[i].pt;
+        codecs[n].encoding_name = pj_str(const_cast<char *>(g711[i].name));
+        codecs[n].clock_rate = CLOCK_RATE;
+        codecs[n].channel_cnt = 1;
+        n++;
+    }
+    *count = n;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::alloc_codec(pjmedia_codec_factory *, const pjmedia_codec_info *info,
+                                   pjmedia_codec **p_codec)
+{
+    G711Codec *codec;
+    if (!pj_list_empty(&factory.codec_list)) {
+        pjmedia_codec *reused = factory.codec_list.next;
+        pj_list_erase(reused);
+        codec = from(reused);
+    } else {
+        void *mem = pj_pool_zalloc(factory.pool, sizeof(G711Codec));
+        if (!mem)
+            return PJ_ENOMEM;
+        codec = new (mem) G711Codec;
+        pj_status_t status = pjmedia_plc_create(factory.pool, CLOCK_RATE, SAMPLES_PER_FRAME,
+                                                0, &codec->plc);
+        if (status == PJ_SUCCESS)
+            status = pjmedia_silence_det_create(factory.pool, CLOCK_RATE, SAMPLES_PER_FRAME,
+                                                &codec->vad);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+
+    codec->base.op = &codec_op;
+    codec->base.factory = &factory.base;
+    codec->base.codec_data = codec;
+    codec->kernels = g711_kernels((info->pt == PJMEDIA_RTP_PT_PCMA)? g711_alaw : g711_ulaw);
+    *p_codec = &codec->base;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::dealloc_codec(pjmedia_codec_factory *, pjmedia_codec *codec)
+{
+    pj_list_push_back(&factory.codec_list, codec);
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::init(pjmedia_codec *, pj_pool_t *)
+{
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::open(pjmedia_codec *codec, pjmedia_codec_param *attr)
+{
+    G711Codec *g711 = from(codec);
+    g711->plc_enabled = (attr->setting.plc != 0);
+    g711->vad_enabled = (attr->setting.vad != 0);
+    g711->last_tx.u64 = 0;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::close(pjmedia_codec *)
+{
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::modify(pjmedia_codec *codec, const pjmedia_codec_param *attr)
+{
+    G711Codec *g711 = from(codec);
+    g711->plc_enabled = (attr->setting.plc != 0);
+    g711->vad_enabled = (attr->setting.vad != 0);
+    return PJ_SUCCESS;
+}
+
+// split a packet into its 10 ms frames
+pj_status_t G711Codec::parse(pjmedia_codec *, void *pkt, pj_size_t pkt_size,
+                             const pj_timestamp *ts, unsigned *frame_cnt, pjmedia_frame frames[])
+{
+    unsigned count = 0;
+    while (pkt_size >= FRAME_SIZE && count < *frame_cnt) {
+        frames[count].type = PJMEDIA_FRAME_TYPE_AUDIO;
+        frames[count].buf = pkt;
+        frames[count].size = FRAME_SIZE;
+        frames[count].timestamp.u64 = ts->u64 + SAMPLES_PER_FRAME * count;
+        pkt = (pj_uint8_t *)pkt + FRAME_SIZE;
+        pkt_size -= FRAME_SIZE;
+        count++;
+    }
+    *frame_cnt = count;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::encode(pjmedia_codec *codec, const pjmedia_frame *input,
+                              unsigned output_buf_len, pjmedia_frame *output)
+{
+    G711Codec *g711 = from(codec);
+    pj_size_t samples = input->size >> 1;
+    if (output_buf_len < samples)
+        return PJMEDIA_CODEC_EPCMTOOSHORT;
+
+    if (g711->vad_enabled) {
+        /* silence is not sent, but for a packet every max silence period */
+        pj_int32_t silence_duration = pj_timestamp_diff32(&g711->last_tx, &input->timestamp);
+        pj_bool_t is_silence = pjmedia_silence_det_detect(
+            g711->vad, (const pj_int16_t *)input->buf, samples, NULL);
+        if (is_silence && (PJMEDIA_CODEC_MAX_SILENCE_PERIOD == -1 ||
+            silence_duration < PJMEDIA_CODEC_MAX_SILENCE_PERIOD * CLOCK_RATE / 1000)) {
+            output->type = PJMEDIA_FRAME_TYPE_NONE;
+            output->buf = NULL;
+            output->size = 0;
+            output->timestamp = input->timestamp;
+            return PJ_SUCCESS;
+        }
+        g711->last_tx = input->timestamp;
+    }
+
+    g711->kernels->encode((const int16_t *)input->buf, (uint8_t *)output->buf, samples);
+    output->type = PJMEDIA_FRAME_TYPE_AUDIO;
+    output->size = samples;
+    output->timestamp = input->timestamp;
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::decode(pjmedia_codec *codec, const pjmedia_frame *input,
+                              unsigned output_buf_len, pjmedia_frame *output)
+{
+    G711Codec *g711 = from(codec);
+    if (output_buf_len < (input->size << 1))
+        return PJMEDIA_CODEC_EPCMTOOSHORT;
+    if (input->size != FRAME_SIZE)
+        return PJMEDIA_CODEC_EFRMINLEN;
+
+    g711->kernels->decode((const uint8_t *)input->buf, (int16_t *)output->buf, input->size);
+    output->type = PJMEDIA_FRAME_TYPE_AUDIO;
+    output->size = input->size << 1;
+    output->timestamp = input->timestamp;
+
+    if (g711->plc_enabled)
+        pjmedia_plc_save(g711->plc, (pj_int16_t *)output->buf);
+    return PJ_SUCCESS;
+}
+
+pj_status_t G711Codec::recover(pjmedia_codec *codec, unsigned output_buf_len,
+                               pjmedia_frame *output)
+{
+    G711Codec *g711 = from(codec);
+    if (!g711->plc_enabled)
+        return PJ_EINVALIDOP;
+    if (output_buf_len < SAMPLES_PER_FRAME * 2)
+        return PJMEDIA_CODEC_EPCMTOOSHORT;
+
+    pjmedia_plc_generate(g711->plc, (pj_int16_t *)output->buf);
+    output->type = PJMEDIA_FRAME_TYPE_AUDIO;
+    output->size = SAMPLES_PER_FRAME * 2;
+    return PJ_SUCCESS;
+}
@@ -0,0 +1,30 @@
+#include "g711_kernel.h"
+
+static const G711Kernels scalar_kernels[2] = {
+    {g711_encode_scalar<g711_ulaw>, g711_decode_scalar<g711_ulaw>, "scalar"},
+    {g711_encode_scalar<g711_alaw>, g711_decode_scalar<g711_alaw>, "scalar"},
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#define G711_X86
+extern const G711Kernels g711_sse41_kernels[2];
+extern const G711Kernels g711_avx2_kernels[2];
+#endif
+
+const G711Kernels* g711_kernels(g711_law law, g711_isa isa)
+{
+#ifdef G711_X86
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    if (isa == isa_best)
+        isa = (avx2)? isa_avx2 : (sse41)? isa_sse41 : isa_scalar;
+    if (isa == isa_avx2)
+        return (avx2)? &g711_avx2_kernels[law] : NULL;
+    if (isa == isa_sse41)
+        return (sse41)? &g711_sse41_kernels[law] : NULL;
+#else
+    if (isa != isa_best && isa != isa_scalar)
+        return NULL;
+#endif
+    return &scalar_kernels[law];
+}
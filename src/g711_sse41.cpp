@@ -0,0 +1,41 @@
+// G.711 kernels for SSE4.1; built with -msse4.1, used if the CPU has it
+#include <immintrin.h>
+#include "g711_kernel.h"
+
+struct VSse41 {
+    typedef __m128i reg;
+    static const size_t lanes = 8;
+
+    static reg load_pcm(const int16_t *p) { return _mm_loadu_si128((const __m128i*)p); }
+    static void store_pcm(int16_t *p, reg x) { _mm_storeu_si128((__m128i*)p, x); }
+    static reg load_bytes(const uint8_t *p) { return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)p)); }
+    static void store_bytes(uint8_t *p, reg x) { _mm_storel_epi64((__m128i*)p, _mm_packus_epi16(x, x)); }
+    static reg zero() { return _mm_setzero_si128(); }
+    static reg set1(int v) { return _mm_set1_epi16((short)v); }
+    static reg add(reg a, reg b) { return _mm_add_epi16(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_epi16(a, b); }
+    static reg subs_epu16(reg a, reg b) { return _mm_subs_epu16(a, b); }
+    static reg and_(reg a, reg b) { return _mm_and_si128(a, b); }
+    static reg andnot(reg a, reg b) { return _mm_andnot_si128(a, b); }
+    static reg or_(reg a, reg b) { return _mm_or_si128(a, b); }
+    static reg xor_(reg a, reg b) { return _mm_xor_si128(a, b); }
+    static reg cmpgt(reg a, reg b) { return _mm_cmpgt_epi16(a, b); }
+    static reg cmpeq(reg a, reg b) { return _mm_cmpeq_epi16(a, b); }
+    static reg abs(reg a) { return _mm_abs_epi16(a); }
+    static reg min_epu16(reg a, reg b) { return _mm_min_epu16(a, b); }
+    static reg max_epi16(reg a, reg b) { return _mm_max_epi16(a, b); }
+    static reg mullo(reg a, reg b) { return _mm_mullo_epi16(a, b); }
+    static reg mulhi_epu16(reg a, reg b) { return _mm_mulhi_epu16(a, b); }
+    template<int N> static reg slli(reg a) { return _mm_slli_epi16(a, N); }
+    template<int N> static reg srli(reg a) { return _mm_srli_epi16(a, N); }
+    // 2^n, n in [0, 7]
+    static reg pow2(reg n) {
+        const reg table = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char)128, 0, 0, 0, 0, 0, 0, 0, 0);
+        return _mm_shuffle_epi8(table, _mm_or_si128(n, set1(0x8000)));
+    }
+};
+
+extern const G711Kernels g711_sse41_kernels[2] = {
+    {g711_encode_vector<VSse41, g711_ulaw>, g711_decode_vector<VSse41, g711_ulaw>, "sse4.1"},
+    {g711_encode_vector<VSse41, g711_alaw>, g711_decode_vector<VSse41, g711_alaw>, "sse4.1"},
+};
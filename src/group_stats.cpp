@@ -0,0 +1,186 @@
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include "group_stats.h"
+
+enum figure {
+    f_mos = 0,
+    f_loss,
+    f_jitter,
+};
+
+// a histogram's bins: the first one's center, and their width
+struct Bins {
+    unsigned count;
+    float first;
+    float width;
+};
+static const Bins mos_bins = {MOS_BINS, 1.0, 0.1};
+static const Bins loss_bins = {LOSS_BINS, 0.25, 0.5};
+static const Bins jitter_bins = {JITTER_BINS, 0.5, 1.0};
+
+static unsigned bin(const Bins& bins, float value)
+{
+    long i = lround((value - bins.first) / bins.width);
+    return (unsigned)std::min<long>(std::max<long>(i, 0), bins.count - 1);
+}
+
+bool GroupStats::stale(const Slice *slices, time_t now)
+{
+    for (int i = 0; i < GROUP_SLICES; i++)
+        if (slices[i].start && now - slices[i].start < GROUP_SLICES * GROUP_SLICE)
+            return false;
+    return true;
+}
+
+void GroupStats::add(Slice *slices, const StreamQuality& quality, time_t now)
+{
+    if (quality.mos <= 0)
+        return;
+    time_t start = now - now % GROUP_SLICE;
+    Slice& slice = slices[(start / GROUP_SLICE) % GROUP_SLICES];
+    if (slice.start > start)
+        return;                     // out of the window
+    if (slice.start != start) {
+        slice = Slice();
+        slice.start = start;
+    }
+    float values[3] = {quality.mos, quality.loss_pct, quality.jitter_ms};
+    for (int f = f_mos; f <= f_jitter; f++) {
+        slice.sum[f] += values[f];
+        slice.min[f] = (slice.reports)? std::min(slice.min[f], values[f]) : values[f];
+        slice.max[f] = (slice.reports)? std::max(slice.max[f], values[f]) : values[f];
+    }
+    slice.mos_hist[bin(mos_bins, quality.mos)]++;
+    slice.loss_hist[bin(loss_bins, quality.loss_pct)]++;
+    slice.jitter_hist[bin(jitter_bins, quality.jitter_ms)]++;
+    slice.reports++;
+}
+
+void GroupStats::add(const std::string& tag, const StreamQuality& tx, const StreamQuality& rx,
+                     time_t now)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto group = groups.find(tag);
+    if (group == groups.end()) {
+        // room made from the groups without reports in the window
+        for (auto g = groups.begin(); groups.size() >= GROUPS_MAX && g != groups.end(); )
+            g = (stale(g->second.tx, now) && stale(g->second.rx, now))? groups.erase(g) : ++g;
+        if (groups.size() >= GROUPS_MAX) {
+            dropped++;
+            return;
+        }
+        group = groups.emplace(tag, Group()).first;
+    }
+    add(group->second.tx, tx, now);
+    add(group->second.rx, rx, now);
+}
+
+// the bin of the p-th percentile, at its center, within the extremes
+static float percentile(const unsigned *hist, const Bins& bins, unsigned long n, float p,
+                        float min, float max)
+{
+    unsigned long target = (unsigned long)ceil(n * p / 100), sum = 0;
+    unsigned i = 0;
+    for (; i < bins.count - 1; i++) {
+        sum += hist[i];
+        if (sum >= target)
+            break;
+    }
+    return std::min(std::max(bins.first + i * bins.width, min), max);
+}
+
+static Distribution distribution(const unsigned *hist, const Bins& bins, unsigned long n,
+                                 double sum, float min, float max)
+{
+    Distribution d = {};
+    if (!n)
+        return d;
+    d.mean = sum / n;
+    d.min = min;
+    d.max = max;
+    d.p5 = percentile(hist, bins, n, 5, min, max);
+    d.p50 = percentile(hist, bins, n, 50, min, max);
+    d.p95 = percentile(hist, bins, n, 95, min, max);
+    return d;
+}
+
+DirSummary GroupStats::summary(const Slice *slices, time_t now, unsigned window)
+{
+    Slice all;
+    for (int i = 0; i < GROUP_SLICES; i++) {
+        const Slice& slice = slices[i];
+        if (!slice.start || !slice.reports || now - slice.start >= (time_t)window)
+            continue;
+        for (int f = f_mos; f <= f_jitter; f++) {
+            all.sum[f] += slice.sum[f];
+            all.min[f] = (all.reports)? std::min(all.min[f], slice.min[f]) : slice.min[f];
+            all.max[f] = (all.reports)? std::max(all.max[f], slice.max[f]) : slice.max[f];
+        }
+        for (int b = 0; b < MOS_BINS; b++)
+            all.mos_hist[b] += slice.mos_hist[b];
+        for (int b = 0; b < LOSS_BINS; b++)
+            all.loss_hist[b] += slice.loss_hist[b];
+        for (int b = 0; b < JITTER_BINS; b++)
+            all.jitter_hist[b] += slice.jitter_hist[b];
+        all.reports += slice.reports;
+    }
+
+    DirSummary summary;
+    summary.reports = all.reports;
+    summary.mos = distribution(all.mos_hist, mos_bins, all.reports,
+                               all.sum[f_mos], all.min[f_mos], all.max[f_mos]);
+    summary.loss_pct = distribution(all.loss_hist, loss_bins, all.reports,
+                                    all.sum[f_loss], all.min[f_loss], all.max[f_loss]);
+    summary.jitter_ms = distribution(all.jitter_hist, jitter_bins, all.reports,
+                                     all.sum[f_jitter], all.min[f_jitter], all.max[f_jitter]);
+    return summary;
+}
+
+std::vector<GroupSummary> GroupStats::summary(time_t now, unsigned window,
+                                              const std::map<std::string, unsigned>& streams) const
+{
+    window = window_of(window);
+    std::lock_guard<std::mutex> lock(m);
+    std::vector<GroupSummary> summaries;
+    for (const auto& group : groups) {
+        auto s = streams.find(group.first);
+        GroupSummary summary;
+        summary.tag = group.first;
+        summary.streams = (s != streams.end())? s->second : 0;
+        summary.tx = GroupStats::summary(group.second.tx, now, window);
+        summary.rx = GroupStats::summary(group.second.rx, now, window);
+        if (summary.streams || summary.tx.reports || summary.rx.reports)
+            summaries.push_back(summary);
+    }
+    // the groups with streams, but no report yet
+    for (const auto& s : streams)
+        if (!groups.count(s.first))
+            summaries.push_back(GroupSummary{s.first, s.second, {}, {}});
+    std::sort(summaries.begin(), summaries.end(),
+              [](const GroupSummary& a, const GroupSummary& b) { return a.tag < b.tag; });
+    return summaries;
+}
+
+// whole slices: the current one, and the previous ones
+unsigned GroupStats::window_of(unsigned sec)
+{
+    sec = std::min<unsigned>(std::max<unsigned>(sec, GROUP_SLICE), GROUP_SLICES * GROUP_SLICE);
+    return (sec + GROUP_SLICE - 1) / GROUP_SLICE * GROUP_SLICE;
+}
+
+unsigned long GroupStats::reports_dropped() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return dropped;
+}
+
+bool GroupStats::valid_tag(const std::string& tag)
+{
+    if (tag.empty() || tag.size() >= TAG_SZ)
+        return false;
+    for (char c : tag)
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.')
+            return false;
+    return true;
+}
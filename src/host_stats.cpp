@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_stats.h"
+
+HostStats::HostStats()
+{
+    sample();
+}
+
+void HostStats::sample()
+{
+    HostLoad load = {};
+    read_cpu(load);
+    read_memory(load);
+    read_udp(load);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    current = load;
+}
+
+HostLoad HostStats::load() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return current;
+}
+
+// CPU idle time since the previous sample, from /proc/stat
+void HostStats::read_cpu(HostLoad &load)
+{
+    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+    FILE *f = fopen("/proc/stat", "r");
+    if (!f)
+        return;
+    int n = fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+    fclose(f);
+    if (n != 8)
+        return;
+
+    unsigned long long total = user + nice + system + idle + iowait + irq + softirq + steal;
+    unsigned long long all_idle = idle + iowait;
+    if (total > cpu_total)
+        load.cpu_idle = (all_idle - cpu_idle) * 100.0 / (total - cpu_total);
+    cpu_total = total;
+    cpu_idle = all_idle;
+    load.cpus = sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+void HostStats::read_memory(HostLoad &load)
+{
+    char line[128];
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f)
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "MemTotal: %lu", &load.mem_total);
+        sscanf(line, "MemAvailable: %lu", &load.mem_available);
+    }
+    fclose(f);
+}
+
+// The "Udp:" lines of /proc/net/snmp: a header line, then a values line
+void HostStats::read_udp(HostLoad &load)
+{
+    char header[512], values[512];
+    FILE *f = fopen("/proc/net/snmp", "r");
+    if (!f)
+        return;
+    while (fgets(header, sizeof(header), f)) {
+        if (strncmp(header, "Udp:", 4))
+            continue;
+        if (!fgets(values, sizeof(values), f))
+            break;
+
+        char *hsave, *vsave;
+        char *name = strtok_r(header, " \n", &hsave);
+        char *value = strtok_r(values, " \n", &vsave);
+        while ((name = strtok_r(NULL, " \n", &hsave)) &&
+               (value = strtok_r(NULL, " \n", &vsave))) {
+            unsigned long v = strtoul(value, NULL, 10);
+            if (!strcmp(name, "InDatagrams"))
+                load.udp_in = v;
+            else if (!strcmp(name, "InErrors"))
+                load.udp_in_errors = v;
+            else if (!strcmp(name, "RcvbufErrors"))
+                load.udp_rcvbuf_errors = v;
+            else if (!strcmp(name, "SndbufErrors"))
+                load.udp_sndbuf_errors = v;
+        }
+        break;
+    }
+    fclose(f);
+}
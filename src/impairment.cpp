@@ -0,0 +1,98 @@
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include "impairment.h"
+
+#define PARETO_SHAPE    2.5
+#define PARETO_CAP      10          // times the mean
+
+static const char *dist_names[] = {"uniform", "normal", "pareto"};
+
+bool impair_active(const ImpairProfile *profile)
+{
+    return profile->loss > 0 || profile->jitter_ms || profile->reorder > 0 || profile->dup > 0;
+}
+
+bool impair_delays(const ImpairProfile *profile)
+{
+    return profile->jitter_ms || profile->reorder > 0;
+}
+
+const char *jitter_dist_name(unsigned dist)
+{
+    return (dist <= jd_pareto)? dist_names[dist] : "unknown";
+}
+
+int jitter_dist_parse(const char *name)
+{
+    for (int i = 0; i <= jd_pareto; i++)
+        if (!strcmp(name, dist_names[i]))
+            return i;
+    return -1;
+}
+
+// the bad state's stationary probability is the mean loss: good to bad
+// at loss/(1 - loss) times bad to good, which is at most 1
+const char *impair_check(const ImpairProfile *profile)
+{
+    if (profile->loss < 0 || profile->loss >= 100)
+        return "loss: 0 to 100 (%), excluded";
+    if (profile->loss > 0 && profile->burst < 1)
+        return "burst: 1 packet or more";
+    if (profile->loss > 0 && profile->loss / (100 - profile->loss) > profile->burst)
+        return "loss too high for its burst: the mean burst must be at least loss/(100 - loss)";
+    if (profile->reorder < 0 || profile->reorder > 100 || profile->dup < 0 || profile->dup > 100)
+        return "reorder, dup: 0 to 100 (%)";
+    if (profile->jitter_dist > jd_pareto)
+        return "jitter_dist: uniform, normal or pareto";
+    return NULL;
+}
+
+void Impairer::configure(const ImpairProfile& profile)
+{
+    this->profile = profile;
+    rng.seed((profile.seed)? profile.seed : std::random_device()());
+    double loss = profile.loss / 100;
+    p_good = (profile.burst >= 1)? 1 / profile.burst : 1;
+    p_bad = (loss < 1)? std::min(1.0, p_good * loss / (1 - loss)) : 1;
+    bad = false;
+}
+
+unsigned Impairer::jitter_us()
+{
+    double mean = profile.jitter_ms * 1000.0;
+    double delay;
+    switch (profile.jitter_dist) {
+    case jd_uniform:
+        delay = uniform(rng) * 2 * mean;
+        break;
+    case jd_pareto: {
+        // scale for the mean: xm * shape / (shape - 1)
+        double xm = mean * (PARETO_SHAPE - 1) / PARETO_SHAPE;
+        delay = std::min(xm / pow(1 - uniform(rng), 1 / PARETO_SHAPE), PARETO_CAP * mean);
+        break;
+    }
+    default: {
+        std::normal_distribution<double> normal(mean, mean / 2);
+        delay = std::max(0.0, normal(rng));
+        break;
+    }
+    }
+    return (unsigned)delay;
+}
+
+ImpairVerdict Impairer::next()
+{
+    ImpairVerdict verdict = {};
+    if (profile.loss > 0) {
+        verdict.drop = bad;
+        bad = (bad)? uniform(rng) >= p_good : uniform(rng) < p_bad;
+    }
+    if (verdict.drop)
+        return verdict;
+    verdict.dup = profile.dup > 0 && uniform(rng) * 100 < profile.dup;
+    verdict.reorder = profile.reorder > 0 && uniform(rng) * 100 < profile.reorder;
+    if (profile.jitter_ms)
+        verdict.delay_us = jitter_us();
+    return verdict;
+}
@@ -4,16 +4,19 @@
 
 InfluxDBClient::InfluxDBClient() {
     connected_ = false;
+    deferred_ = false;
 }
 
 InfluxDBClient::InfluxDBClient(const std::string& url,
                              const std::string& org,
                              const std::string& bucket,
-                             const std::string& token)
+                             const std::string& token,
+                             bool deferred)
     : url_(url), org_(org), bucket_(bucket), token_(token),
       connected_(false), curl_(nullptr), headers_(nullptr),
-      not_connect_notify(false) {
-    connected_ = initializeCurl();
+      not_connect_notify(false), deferred_(deferred) {
+    if (!deferred_)
+        connected_ = initializeCurl();
 }
 
 InfluxDBClient::~InfluxDBClient() {
@@ -56,6 +59,10 @@ bool InfluxDBClient::send(const std::string& measurement,
                          const std::string& tags,
                          const std::string& fields,
                          int64_t timestamp) {
+    if (deferred_) {
+        deferred_ = false;
+        connected_ = initializeCurl();
+    }
     if (!connected_) {
         if (!not_connect_notify) {
             std::cerr << "Not connected to InfluxDB" << std::endl;
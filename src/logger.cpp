@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "logger.h"
+#include "thread_stats.h"
+
+#define LOG_SLOTS       256     // per thread ring
+#define LOG_MSG_SZ      256
+#define LOG_DRAIN_MS    10
+
+typedef struct LogEntry_t {
+    unsigned long seq;          // global order, across the threads
+    log_level level;
+    char msg[LOG_MSG_SZ];
+} LogEntry;
+
+// Single producer (its thread), single consumer (the drain thread)
+struct LogRing {
+    LogEntry slots[LOG_SLOTS];
+    std::atomic<unsigned> head{0};      // written by the producer
+    std::atomic<unsigned> tail{0};      // written by the consumer
+    std::atomic<bool> in_use{true};     // owned by a thread
+    LogRing *next = nullptr;
+};
+
+// The rings are never freed: those of the exited threads are taken over
+// by the new ones
+static std::atomic<LogRing*> g_rings{nullptr};
+static std::atomic<unsigned long> g_seq{0};
+static std::atomic<unsigned long> g_dropped{0};
+static std::atomic<int> g_level{log_info};
+static std::atomic<bool> g_running{false};
+static std::thread g_drain_thread;
+static bool g_journal = false;
+
+static const char *level_names[] = {"error", "warning", "info", "debug"};
+static const int syslog_prio[] = {3, 4, 6, 7};
+
+struct RingOwner {
+    LogRing *ring = nullptr;
+    ~RingOwner() {
+        if (ring)
+            ring->in_use.store(false, std::memory_order_release);
+    }
+};
+static thread_local RingOwner t_owner;
+
+static LogRing* own_ring()
+{
+    if (t_owner.ring)
+        return t_owner.ring;
+
+    for (LogRing *ring = g_rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+        bool in_use = false;
+        if (ring->in_use.compare_exchange_strong(in_use, true))
+            return t_owner.ring = ring;
+    }
+
+    LogRing *ring = new LogRing;
+    ring->next = g_rings.load();
+    while (!g_rings.compare_exchange_weak(ring->next, ring))
+        ;
+    return t_owner.ring = ring;
+}
+
+bool LogRateLimit::allow(unsigned *n_suppressed)
+{
+    time_t now = time(NULL);
+    time_t prev = window.load(std::memory_order_relaxed);
+    if (now != prev && window.compare_exchange_strong(prev, now))
+        count.store(0, std::memory_order_relaxed);
+
+    if (count.fetch_add(1, std::memory_order_relaxed) < LOG_BURST) {
+        *n_suppressed = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void Logger::log(log_level level, unsigned suppressed, const char *fmt, ...)
+{
+    LogRing *ring = own_ring();
+    unsigned head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= LOG_SLOTS) {
+        g_dropped++;
+        return;
+    }
+
+    LogEntry &entry = ring->slots[head % LOG_SLOTS];
+    entry.seq = g_seq.fetch_add(1, std::memory_order_relaxed);
+    entry.level = level;
+    int n = 0;
+    if (suppressed)
+        n = snprintf(entry.msg, LOG_MSG_SZ, "(%u similar messages suppressed) ", suppressed);
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(entry.msg + n, LOG_MSG_SZ - n, fmt, args);
+    va_end(args);
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+static void drain()
+{
+    static std::vector<LogEntry*> entries;
+    std::vector<std::pair<LogRing*, unsigned>> drained;
+
+    entries.clear();
+    for (LogRing *ring = g_rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+        unsigned tail = ring->tail.load(std::memory_order_relaxed);
+        unsigned head = ring->head.load(std::memory_order_acquire);
+        if (tail == head)
+            continue;
+        for (unsigned i = tail; i != head; i++)
+            entries.push_back(&ring->slots[i % LOG_SLOTS]);
+        drained.push_back({ring, head});
+    }
+    if (entries.empty())
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [](const LogEntry *a, const LogEntry *b) { return a->seq < b->seq; });
+    for (LogEntry *entry : entries) {
+        // under systemd, the journal takes the priority from a <N> prefix
+        if (g_journal)
+            printf("<%d>", syslog_prio[entry->level]);
+        puts(entry->msg);
+    }
+    fflush(stdout);
+
+    for (auto& ring_head : drained)
+        ring_head.first->tail.store(ring_head.second, std::memory_order_release);
+}
+
+void Logger::start()
+{
+    g_journal = getenv("JOURNAL_STREAM") != NULL;
+    g_running = true;
+    g_drain_thread = std::thread([] {
+        set_thread_name("log-drain");
+        while (g_running) {
+            drain();
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOG_DRAIN_MS));
+        }
+    });
+}
+
+void Logger::stop()
+{
+    if (g_running.exchange(false))
+        g_drain_thread.join();
+    drain();
+    unsigned long dropped = g_dropped.exchange(0);
+    if (dropped)
+        printf("%lu log messages dropped\n", dropped);
+    fflush(stdout);
+}
+
+void Logger::set_level(log_level level)
+{
+    g_level.store(level, std::memory_order_relaxed);
+}
+
+log_level Logger::level()
+{
+    return (log_level)g_level.load(std::memory_order_relaxed);
+}
+
+const char* Logger::level_name(log_level level)
+{
+    return level_names[level];
+}
+
+bool Logger::parse_level(const char *name, log_level *level)
+{
+    for (int i = log_error; i <= log_debug; i++)
+        if (!strcmp(name, level_names[i])) {
+            *level = (log_level)i;
+            return true;
+        }
+    return false;
+}
+
+unsigned long Logger::dropped()
+{
+    return g_dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::write_raw(const char *msg)
+{
+    ssize_t n = write(STDERR_FILENO, msg, strlen(msg));
+    (void)n;
+}
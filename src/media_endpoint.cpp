@@ -7,6 +7,10 @@
 #include "shared_list.h"
 #include "rtp_endpoint.h"
 #include "influxdb_client.h"
+#include "pcap_replay.h"
+#include "thread_stats.h"
+#include "media_library.h"
+#include "logger.h"
 
 using namespace std;
 
@@ -17,10 +21,29 @@ static const char desc[] =
 "where <options>:                                                           \n"
 "                                                                           \n"
 "--server                   Server mode (default: Client)                   \n"
+"--bidir                    Send/recv mode: send the wavefile and measure   \n"
+"                           the received stream (both Client and Server)    \n"
 "--local-port=PORT          Local RTP port (default: 4000)                  \n"
 "--duration=DUR             Call duration (ms)                              \n"
 "                           Server default: 60s                             \n"
 "--codec=CODEC              ITU G.711 'pcma' or 'pcmu' (default: pcmu)      \n"
+"--ptime=MS                 Packet time: 10, 20, 30... 60 ms                \n"
+"                           (default: the codec's, 20 ms)                   \n"
+"--dtx                      DTX: silence not sent (VAD), but for a periodic \n"
+"                           refresh                                         \n"
+"--kernel-ts                Kernel timestamps of the RTP packets: jitter on \n"
+"                           them, and the host's own delay apart            \n"
+"--owd                      One-way delay, between media_endpoints: the RTP \n"
+"                           packets carry their send time (RFC 8285 header  \n"
+"                           extension); the hosts' clocks must be synced    \n"
+"--rtcp-xr=MODE             RTCP-XR VoIP metrics sent and parsed: 'both'    \n"
+"                           sides report, or only the 'sender' side, with   \n"
+"                           the receiver's figures (pjmedia built with XR)  \n"
+"--fast-start               InfluxDB client deferred to the first report,   \n"
+"                           only the codec in use registered, pools         \n"
+"                           pre-sized                                       \n"
+"--rt-priority=PRIO         SCHED_FIFO priority of the sender thread        \n"
+"--log-level=LEVEL          error, warning, info or debug (default: info)   \n"
 "--shared-mem=MEM           The name of memory shared with media_server     \n"
 "                           (default: %s)                                   \n"
 "                                                                           \n"
@@ -28,6 +51,12 @@ static const char desc[] =
 "--remote-addr=ADDRESS      Remote RTP address                              \n"
 "--remote-port=PORT         Remote RTP port                                 \n"
 "--wavefile=filename        WAVE audio file (mono 8000Hz) (default: %s)     \n"
+"--replay=PCAP              Replay an RTP flow of a pcap/pcapng capture,    \n"
+"                           instead of the wavefile (also with --bidir)     \n"
+"--replay-flow=FLOW         The flow's SSRC (0x...) or UDP destination port \n"
+"                           (default: the capture's first RTP flow)         \n"
+"--replay-speed=SPEED       Timing scale: 2 replays twice as fast           \n"
+"                           (default: 1, the capture's timing)              \n"
 "                                                                           \n"
 "--help -h                  This help                                       \n"
 "                                                                           \n"
@@ -41,66 +70,447 @@ static const char desc[] =
 static Data conf;
 string g_wavefile = SAMPLE_WAV;
 string g_codec;
+string g_replay_file;
+string g_replay_flow;
+double g_replay_speed = 1;
+PcapReplay g_replay;
+MediaSource g_source;               // the media library source played, mapped
 string g_shared_mem;
 InfluxDBClient *g_pInfluxdb;
+SharedList *g_pSharedList;
 condition_variable cv;
 mutex cv_m;
+bool b_reused = false;              // protected by cv_m
+condition_variable release_cv;
+mutex release_m;
 atomic<bool> b_running{true};
+bool b_first_packet = false;        // protected by release_m
 
 
 bool g_server = false;
+int g_rt_prio = 0;
+bool g_kernel_ts = false;
+bool g_owd = false;
+bool g_fast_start = false;
+
+enum xr_mode {xr_off = 0, xr_both, xr_sender};
+xr_mode g_rtcp_xr = xr_off;
+
+// startup phases (usec), per startup_phase; published in the registry
+unsigned g_startup_us[SP_PHASES];
+unsigned long long g_spawn_ns;      // CLOCK_MONOTONIC: media_server's fork, or main()
+unsigned long long g_lap_ns;        // the end of the last phase timed
+bool g_stream_started = false;
+
+unsigned long long monotonic_ns()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// time a startup phase, from the end of the previous one
+void startup_lap(startup_phase phase)
+{
+    unsigned long long now = monotonic_ns();
+    g_startup_us[phase] = (now - g_lap_ns) / 1000;
+    g_lap_ns = now;
+}
+
+// the last phase, once the first packet is out (or in); true when just timed
+bool startup_done(RTP_endpoint &endpoint)
+{
+    if (!g_stream_started || g_startup_us[sp_total])
+        return false;
+    unsigned long long first_ns = endpoint.getFirstPacketTime();
+    if (!first_ns)
+        return false;
+    g_startup_us[sp_first_packet] = (first_ns > g_lap_ns)? (first_ns - g_lap_ns) / 1000 : 0;
+    g_startup_us[sp_total] = (first_ns - g_spawn_ns) / 1000;
+    LOG(log_debug, "Startup (us): exec %u, args %u, registry %u, influx %u, pjlib %u, "
+        "media %u, codecs %u, transport %u, stream %u, first packet %u; total %u",
+        g_startup_us[sp_exec], g_startup_us[sp_args], g_startup_us[sp_registry],
+        g_startup_us[sp_influx], g_startup_us[sp_pjlib], g_startup_us[sp_media],
+        g_startup_us[sp_codecs], g_startup_us[sp_transport], g_startup_us[sp_stream],
+        g_startup_us[sp_first_packet], g_startup_us[sp_total]);
+    return true;
+}
+
+// publish the startup's timings in the registry, once complete
+void publish_startup()
+{
+    g_pSharedList->lock();
+    Data *data = g_pSharedList->fetch_element(conf.port);
+    if (data && data->reuse_cnt == conf.reuse_cnt) {
+        memcpy(data->startup_us, g_startup_us, sizeof(g_startup_us));
+        g_pSharedList->touch(data);
+    }
+    g_pSharedList->unlock();
+}
+
+void stream_started()
+{
+    if (!g_stream_started) {
+        startup_lap(sp_stream);
+        g_stream_started = true;
+    }
+}
+
+// from the media threads, at the first packet: wake the stream's wait
+void first_packet_out(void *)
+{
+    lock_guard<mutex> lk(release_m);
+    b_first_packet = true;
+    release_cv.notify_one();
+}
 
 void endThread() {
-    lock_guard<mutex> lk(cv_m);
     b_running = false;
+    {
+        // interrupt a running stream first; it holds cv_m
+        lock_guard<mutex> lk(release_m);
+        release_cv.notify_one();
+    }
+    lock_guard<mutex> lk(cv_m);
     cv.notify_one();
 }
 
+// sleep for timeout; returns true if the endpoint got released meanwhile.
+// Meanwhile, the startup is timed and published at the first packet
+bool wait_release(RTP_endpoint &endpoint, chrono::milliseconds timeout)
+{
+    auto deadline = chrono::steady_clock::now() + timeout;
+    unique_lock<mutex> lk(release_m);
+    while (release_cv.wait_until(lk, deadline, [] { return !b_running || b_first_packet; })) {
+        if (!b_running)
+            return true;
+        b_first_packet = false;
+        lk.unlock();
+        if (startup_done(endpoint))
+            publish_startup();
+        lk.lock();
+    }
+    return false;
+}
+
+
+pjmedia_dir stream_dir()
+{
+    if (conf.bidir)
+        return PJMEDIA_DIR_ENCODING_DECODING;
+    return (g_server)? PJMEDIA_DIR_DECODING : PJMEDIA_DIR_ENCODING;
+}
+
+// the kernel timestamps' figures, of the received packets or the sent ones,
+// as fields; none if not measured
+string kernel_ts_fields(const KernelTsStat &stat, bool rx)
+{
+    const pj_math_stat &jitter = (rx)? stat.rx_jitter : stat.tx_jitter;
+    const pj_math_stat &delay = (rx)? stat.rx_host_delay : stat.tx_host_delay;
+    if (!delay.n)
+        return "";
+    string fields = ",kernel_jitter_us=" + to_string(jitter.mean) +
+        ",host_delay_us=" + to_string(delay.mean) +
+        ",host_delay_max_us=" + to_string(delay.max);
+    if (rx)
+        fields += ",interarrival_us=" + to_string(stat.rx_interarrival.mean);
+    return fields;
+}
+
+// the one-way delay of the received packets, as fields; none if not measured
+string owd_fields(const OwdStat &stat)
+{
+    if (!stat.owd.n)
+        return "";
+    return ",owd_us=" + to_string(stat.owd.mean) +
+        ",owd_min_us=" + to_string(stat.owd.min) +
+        ",owd_max_us=" + to_string(stat.owd.max) +
+        ",owd_p50_us=" + to_string(owd_percentile(&stat, 50)) +
+        ",owd_p95_us=" + to_string(owd_percentile(&stat, 95)) +
+        ",owd_p99_us=" + to_string(owd_percentile(&stat, 99));
+}
+
+// the SRTP protect (TX) or unprotect (RX) CPU time since the last report,
+// as fields; none if no SRTP
+SrtpStat g_srtp_last;
+
+string srtp_fields(const SrtpStat &stat, bool rx)
+{
+    unsigned long pkts = (rx)? stat.unprotect_pkts - g_srtp_last.unprotect_pkts :
+                               stat.protect_pkts - g_srtp_last.protect_pkts;
+    unsigned long long ns = (rx)? stat.unprotect_ns - g_srtp_last.unprotect_ns :
+                                  stat.protect_ns - g_srtp_last.protect_ns;
+    if (!conf.srtp[0] || !pkts)
+        return "";
+    string fields = ",srtp_cpu_us=" + to_string(ns / 1000) +
+        ",srtp_ns_per_pkt=" + to_string(ns / pkts);
+    if (rx)
+        fields += ",srtp_auth_fail=" + to_string(stat.unprotect_fail - g_srtp_last.unprotect_fail);
+    return fields;
+}
+
+// the sent packets impaired since the last report, as fields; none if
+// no impairment
+ImpairStat g_impair_last;
+
+string impair_fields(const ImpairStat &stat)
+{
+    unsigned long pkts = stat.packets - g_impair_last.packets;
+    unsigned long lost = stat.lost - g_impair_last.lost;
+    if (!impair_active(&conf.impair) || !pkts)
+        return "";
+    unsigned long long delay_us = stat.delay_us - g_impair_last.delay_us;
+    return ",impair_lost=" + to_string(lost) +
+        ",impair_loss_pct=" + to_string(lost * 100.0 / pkts) +
+        ",impair_dup=" + to_string(stat.duplicated - g_impair_last.duplicated) +
+        ",impair_reordered=" + to_string(stat.reordered - g_impair_last.reordered) +
+        ",impair_delay_us=" + to_string((pkts > lost)? delay_us / (pkts - lost) : 0);
+}
+
+// RTCP-XR VoIP metrics and statistics summary of a direction, as fields;
+// none until an XR block. The rates are in 1/256, the durations in ms
+string xr_fields(const pjmedia_rtcp_xr_stream_stat &xr)
+{
+    if (!xr.voip_mtc.update.sec)
+        return "";
+    string fields =
+        ",xr_loss_pct=" + to_string(xr.voip_mtc.loss_rate * 100 / 256.0) +
+        ",xr_discard_pct=" + to_string(xr.voip_mtc.discard_rate * 100 / 256.0) +
+        ",xr_burst_density_pct=" + to_string(xr.voip_mtc.burst_den * 100 / 256.0) +
+        ",xr_burst_ms=" + to_string(xr.voip_mtc.burst_dur) +
+        ",xr_gap_density_pct=" + to_string(xr.voip_mtc.gap_den * 100 / 256.0) +
+        ",xr_gap_ms=" + to_string(xr.voip_mtc.gap_dur) +
+        ",xr_rtt_ms=" + to_string(xr.voip_mtc.rnd_trip_delay) +
+        ",xr_end_delay_ms=" + to_string(xr.voip_mtc.end_sys_delay) +
+        ",xr_jb_nom_ms=" + to_string(xr.voip_mtc.jb_nom) +
+        ",xr_jb_max_ms=" + to_string(xr.voip_mtc.jb_max);
+    if (xr.voip_mtc.r_factor != XR_UNAVAILABLE)
+        fields += ",xr_r_factor=" + to_string(xr.voip_mtc.r_factor);
+    if (xr.voip_mtc.mos_lq != XR_UNAVAILABLE)
+        fields += ",xr_mos_lq=" + to_string(xr.voip_mtc.mos_lq / 10.0);
+    if (xr.voip_mtc.mos_cq != XR_UNAVAILABLE)
+        fields += ",xr_mos_cq=" + to_string(xr.voip_mtc.mos_cq / 10.0);
+    if (xr.stat_sum.update.sec) {
+        fields += ",xr_lost=" + to_string(xr.stat_sum.lost) +
+            ",xr_dup=" + to_string(xr.stat_sum.dup);
+        if (xr.stat_sum.j)
+            fields += ",xr_jitter_us=" + to_string(xr.stat_sum.jitter.mean);
+    }
+    return fields;
+}
+
+// publish a report's quality in the registry, for media_server's rollups
+// per group tag
+void publish_quality(const StreamQuality &tx, const StreamQuality &rx)
+{
+    g_pSharedList->lock();
+    Data *data = g_pSharedList->fetch_element(conf.port);
+    if (data && data->reuse_cnt == conf.reuse_cnt) {
+        data->quality.reports++;
+        data->quality.tx = tx;
+        data->quality.rx = rx;
+        g_pSharedList->touch(data);
+    }
+    g_pSharedList->unlock();
+}
+
+void report_MOS(RTP_endpoint &endpoint, const char *type)
+{
+    KernelTsStat ts_stat = {};
+    endpoint.getKernelTsStat(&ts_stat, true);
+    // MOS first: it takes the one-way delay, if any
+    StreamQuality tx, rx;
+    endpoint.get_quality(&tx, &rx);
+    publish_quality(tx, rx);
+    float tx_mos = tx.mos, rx_mos = rx.mos;
+
+    // XR sender mode: the sending side reports, the receiver's figures in band
+    if (g_rtcp_xr == xr_sender && g_server)
+        return;
+
+    OwdStat owd_stat = {};
+    endpoint.getOwdStat(&owd_stat, true);
+    SrtpStat srtp_stat;
+    endpoint.getSrtpStat(&srtp_stat);
+    ImpairStat impair_stat;
+    endpoint.getImpairStat(&impair_stat);
+    pjmedia_rtcp_xr_stat xr_stat = {};
+    endpoint.getXrStat(&xr_stat);
+    // media_server's profile, but the default one, and the caller's group
+    string tags = (conf.profile[0] && strcmp(conf.profile, DEFAULT_PROFILE))?
+        string(",profile=") + conf.profile : "";
+    if (conf.tag[0])
+        tags += string(",group=") + conf.tag;
+    if (conf.bidir) {
+        // TX and RX reported separately, from the same endpoint
+        g_pInfluxdb->send("audio", "type=TX,mode=sendrecv" + tags,
+            "mos=" + to_string(tx_mos) + kernel_ts_fields(ts_stat, false) +
+            srtp_fields(srtp_stat, false) + impair_fields(impair_stat) + xr_fields(xr_stat.tx));
+        g_pInfluxdb->send("audio", "type=RX,mode=sendrecv" + tags,
+            "mos=" + to_string(rx_mos) + kernel_ts_fields(ts_stat, true) + owd_fields(owd_stat) +
+            srtp_fields(srtp_stat, true) + xr_fields(xr_stat.rx));
+    } else if (g_server)
+        g_pInfluxdb->send("audio", type + tags,
+            "mos=" + to_string(rx_mos) + kernel_ts_fields(ts_stat, true) + owd_fields(owd_stat) +
+            srtp_fields(srtp_stat, true) + xr_fields(xr_stat.rx));
+    else
+        g_pInfluxdb->send("audio", type + tags,
+            "mos=" + to_string(tx_mos) + kernel_ts_fields(ts_stat, false) +
+            srtp_fields(srtp_stat, false) + impair_fields(impair_stat) + xr_fields(xr_stat.tx));
+    g_srtp_last = srtp_stat;
+    g_impair_last = impair_stat;
+}
+
+unsigned long long srtp_cpu_ns(RTP_endpoint &endpoint)
+{
+    SrtpStat stat;
+    endpoint.getSrtpStat(&stat);
+    return stat.protect_ns + stat.unprotect_ns;
+}
+
+// publish the endpoint's own figures in its registry entry
+void publish(RTP_endpoint &endpoint, ep_state state)
+{
+    startup_done(endpoint);
+    g_pSharedList->lock();
+    Data *data = g_pSharedList->fetch_element(conf.port);
+    if (data) {
+        data->pool_used = endpoint.getPoolUsage();
+        memcpy(data->startup_us, g_startup_us, sizeof(g_startup_us));
+        data->srtp_cpu_ns = srtp_cpu_ns(endpoint);
+        // unless released, or already reused by media_server
+        if (data->state != ep_released && data->reuse_cnt == conf.reuse_cnt) {
+            data->state = state;
+            if (state == ep_idle)
+                data->idle_since = time(NULL);
+        }
+        g_pSharedList->touch(data);
+    }
+    g_pSharedList->unlock();
+}
+
+// publish the stream's packet rate; before its stats are reset
+void publish_rate(RTP_endpoint &endpoint)
+{
+    float pps = endpoint.getPacketRate();
+    startup_done(endpoint);
+    g_pSharedList->lock();
+    Data *data = g_pSharedList->fetch_element(conf.port);
+    if (data && data->reuse_cnt == conf.reuse_cnt) {
+        data->pps = pps;
+        memcpy(data->startup_us, g_startup_us, sizeof(g_startup_us));
+        data->srtp_cpu_ns = srtp_cpu_ns(endpoint);
+        g_pSharedList->touch(data);
+    }
+    g_pSharedList->unlock();
+}
+
+// the media library source, or else the wavefile, through the stream;
+// or the capture, alongside it
+void start_sending(RTP_endpoint &endpoint)
+{
+    if (g_replay.count()) {
+        endpoint.startStream();
+        endpoint.startReplay(&g_replay, g_replay_speed);
+    } else if (conf.source[0]) {
+        // another source: the previous one unmapped once its player is gone
+        MediaSource previous;
+        string error;
+        if (g_source.name() != conf.source) {
+            if (!previous.open(MediaLibrary::shm_name(g_shared_mem, conf.source),
+                               conf.source, error)) {
+                LOG(log_warning, "Source %s: %s; playing the wavefile", conf.source,
+                    error.c_str());
+                endpoint.startStream(g_wavefile.c_str());
+                endpoint.startStreaming();
+                return;
+            }
+            g_source.swap(previous);
+        }
+        endpoint.startStream(g_source.name().c_str(), g_source.pcm(), g_source.size(),
+                             g_source.clock_rate());
+        endpoint.startStreaming();
+    } else {
+        endpoint.startStream(g_wavefile.c_str());
+        endpoint.startStreaming();
+    }
+}
+
+void stop_sending(RTP_endpoint &endpoint)
+{
+    if (g_replay.count())
+        endpoint.stopReplay();
+    else
+        endpoint.stopStreaming();
+}
 
 void endpoint_thread()
 {
     pj_thread_desc thread_desc;
     pj_thread_t *pj_thread;
     pj_thread_register("endpoint_thread", thread_desc, &pj_thread);
+    set_thread_name("ep-stream");
 
     try
     {
-        pjmedia_dir dir = (g_server)? PJMEDIA_DIR_DECODING : PJMEDIA_DIR_ENCODING;
-        cout << "create endpoint: " << SharedList::print_element(&conf) << endl;
-        RTP_endpoint endpoint(conf.port, LOG_ERROR, dir, g_codec.c_str());
+        LOG(log_info, "create endpoint: %s", SharedList::print_element(&conf));
+        RTP_endpoint endpoint(conf.port, LOG_ERROR, stream_dir(), g_codec.c_str(), g_fast_start);
+        const InitTimes &init = endpoint.getInitTimes();
+        g_startup_us[sp_pjlib] = init.pjlib;
+        g_startup_us[sp_media] = init.media;
+        g_startup_us[sp_codecs] = init.codecs;
+        g_startup_us[sp_transport] = init.transport;
+        g_lap_ns = monotonic_ns();
+        endpoint.onFirstPacket(first_packet_out, NULL);
+        endpoint.setRealtime(g_rt_prio);
+        endpoint.setKernelTimestamps(g_kernel_ts);
+        endpoint.setOneWayDelay(g_owd);
+        if (!endpoint.setRtcpXr(g_rtcp_xr != xr_off))
+            LOG(log_warning, "RTCP-XR off: pjmedia built without it");
         while (b_running) {
             unique_lock<mutex> lk(cv_m);
+            endpoint.setDirection(stream_dir());
+            endpoint.setPacketization(conf.ptime, conf.dtx);
+            endpoint.setSrtp(conf.srtp, conf.srtp_key);
+            endpoint.setImpairment(conf.impair);
             endpoint.setRemoteAddr(conf.dest_address, conf.dest_port);
             endpoint.createStream();
+            publish(endpoint, ep_active);
             if (g_server) {
-                 endpoint.startStream();
+                 if (conf.bidir)
+                     start_sending(endpoint);
+                 else
+                     endpoint.startStream();
+                 stream_started();
                  lk.unlock();
-                 while(true) {
-                    this_thread::sleep_for(chrono::seconds(10));
+                 while(!wait_release(endpoint, chrono::seconds(10))) {
                     // endpoint.print_stream_stat();
-                    g_pInfluxdb->send("audio", "type=TX",
-                        "mos=" + to_string(endpoint.get_MOS()));
-                    if (!b_running) return;
+                    publish_rate(endpoint);
+                    report_MOS(endpoint, "type=TX");
                  }
+                 return;
 
             } else {
-                endpoint.startStream(g_wavefile.c_str());
-                endpoint.startStreaming();
-                this_thread::sleep_for(chrono::milliseconds(conf.duration));
+                start_sending(endpoint);
+                stream_started();
+                wait_release(endpoint, chrono::milliseconds(conf.duration));
                 // endpoint.print_stream_stat();
-                g_pInfluxdb->send("audio", "type=RX",
-                    "mos=" + to_string(endpoint.get_MOS()));
-                endpoint.stopStreaming();
+                publish_rate(endpoint);
+                report_MOS(endpoint, "type=RX");
+                stop_sending(endpoint);
+                publish(endpoint, ep_idle);
             }
 
             // cout << "Wait\n";
-            cv.wait(lk);
+            cv.wait(lk, [] { return b_reused || !b_running; });
+            b_reused = false;
         }
     }
     catch (const char *e)
     {
-        cout << "Failed to create endpoint: " << SharedList::print_element(&conf) << endl;
-        cout << e << endl;
+        LOG(log_error, "Failed to create endpoint: %s", SharedList::print_element(&conf));
+        LOG(log_error, "%s", e);
+        Logger::stop();
         _exit(1);
     }
 }
@@ -108,6 +518,9 @@ void endpoint_thread()
 
 int main(int argc, char *argv[])
 {
+    unsigned long long main_ns = monotonic_ns();
+    g_spawn_ns = g_lap_ns = main_ns;
+
     pj_getopt_option long_options[] = {
         {"local-port",          1, 0, 'p'},
         {"remote-addr",         1, 0, 'i'},
@@ -116,7 +529,19 @@ int main(int argc, char *argv[])
         {"wavefile",            1, 0, 'w'},
         {"codec",               1, 0, 'c'},
         {"server",              0, 0, 's'},
+        {"bidir",               0, 0, 'b'},
         {"shared-mem",          1, 0, 'm'},
+        {"ptime",               1, 0, 't'},
+        {"dtx",                 0, 0, 'x'},
+        {"replay",              1, 0, 'y'},
+        {"replay-flow",         1, 0, 'f'},
+        {"replay-speed",        1, 0, 'e'},
+        {"kernel-ts",           0, 0, 'k'},
+        {"owd",                 0, 0, 'o'},
+        {"fast-start",          0, 0, 'F'},
+        {"rtcp-xr",             1, 0, 'X'},
+        {"rt-priority",         1, 0, 'P'},
+        {"log-level",           1, 0, 'l'},
         {"help",                0, 0, 'h'},
         { NULL, 0, 0, 0 },
     };
@@ -157,6 +582,10 @@ int main(int argc, char *argv[])
             g_server = true;
             break;
 
+        case 'b':
+            conf.bidir = 1;
+            break;
+
         case 'w':
             g_wavefile = pj_optarg;
             break;
@@ -165,10 +594,75 @@ int main(int argc, char *argv[])
             g_codec = pj_optarg;
             break;
 
+        case 'y':
+            g_replay_file = pj_optarg;
+            break;
+
+        case 'f':
+            g_replay_flow = pj_optarg;
+            break;
+
+        case 'e':
+            g_replay_speed = atof(pj_optarg);
+            if (g_replay_speed <= 0) {
+                printf("Error: invalid replay speed %s\n", pj_optarg);
+                return 1;
+            }
+            break;
+
         case 'm':
             g_shared_mem = pj_optarg;
             break;
 
+        case 't':
+            conf.ptime = atoi(pj_optarg);
+            if (conf.ptime % 10 || conf.ptime > 60) {
+                printf("Error: invalid ptime %s\n", pj_optarg);
+                return 1;
+            }
+            break;
+
+        case 'x':
+            conf.dtx = 1;
+            break;
+
+        case 'k':
+            g_kernel_ts = true;
+            break;
+
+        case 'o':
+            g_owd = true;
+            break;
+
+        case 'F':
+            g_fast_start = true;
+            break;
+
+        case 'X':
+            if (!strcmp(pj_optarg, "both"))
+                g_rtcp_xr = xr_both;
+            else if (!strcmp(pj_optarg, "sender"))
+                g_rtcp_xr = xr_sender;
+            else {
+                printf("Invalid RTCP-XR mode %s: both or sender\n", pj_optarg);
+                return 1;
+            }
+            break;
+
+        case 'P':
+            g_rt_prio = atoi(pj_optarg);
+            break;
+
+        case 'l': {
+            log_level level;
+            if (!Logger::parse_level(pj_optarg, &level)) {
+                printf("Error: invalid log level %s\n", pj_optarg);
+                return 1;
+            }
+            Logger::set_level(level);
+            break;
+        }
+
         case 'h':
             printf(desc, basename(argv[0]), SHM_NAME, SAMPLE_WAV, PJ_VERSION);
             return 0;
@@ -181,13 +675,43 @@ int main(int argc, char *argv[])
         }
     }
 
+    // indexed once, for all the streams of the endpoint
+    if (!g_replay_file.empty()) {
+        string error;
+        if (!g_replay.open(g_replay_file.c_str(), g_replay_flow, error)) {
+            printf("Error: replay %s\n", error.c_str());
+            return 1;
+        }
+    }
+    startup_lap(sp_args);
+
     SharedList shared_list(t_client, g_shared_mem.c_str());
+    g_pSharedList = &shared_list;
+    // the exec: from media_server's fork, if it launched us
+    shared_list.lock();
+    Data *self = shared_list.fetch_element(conf.port);
+    if (self && self->spawn_ns && self->spawn_ns < main_ns) {
+        g_spawn_ns = self->spawn_ns;
+        g_startup_us[sp_exec] = (main_ns - g_spawn_ns) / 1000;
+    }
+    // SRTP, the library source, the impairment, the profile and the group
+    // tag, from the registry: the SRTP key is not to be seen on the command line
+    if (self) {
+        memcpy(conf.srtp, self->srtp, sizeof(conf.srtp));
+        memcpy(conf.srtp_key, self->srtp_key, sizeof(conf.srtp_key));
+        memcpy(conf.source, self->source, sizeof(conf.source));
+        conf.impair = self->impair;
+        memcpy(conf.profile, self->profile, sizeof(conf.profile));
+        memcpy(conf.tag, self->tag, sizeof(conf.tag));
+    }
+    shared_list.unlock();
 
     // Block SIGRTMIN
     sigset_t rt_sig;
     sigemptyset(&rt_sig);
     sigaddset(&rt_sig, SIGRTMIN);
     sigprocmask(SIG_SETMASK, &rt_sig, NULL);
+    Logger::start();
     siginfo_t info;
     timespec timeout;
     // TODO: configurable
@@ -196,6 +720,7 @@ int main(int argc, char *argv[])
         conf.duration = 60000;
     timeout.tv_sec = conf.duration * 2 / 1000;
     timeout.tv_nsec = 0;
+    startup_lap(sp_registry);
 
     char *influx_URL = getenv("influx_URL");
     if (influx_URL != NULL) {
@@ -203,12 +728,19 @@ int main(int argc, char *argv[])
             string(influx_URL),
             string(getenv("influx_org")),
             string(getenv("influx_bucket")),
-            string(getenv("influx_token"))
+            string(getenv("influx_token")),
+            g_fast_start
         );
     } else
         g_pInfluxdb = new InfluxDBClient();
+    startup_lap(sp_influx);
 
 
+    if (g_replay.count())
+        LOG(log_info, "Replay of %s: SSRC 0x%08x, %zu packets, %.1f s",
+            g_replay_file.c_str(), g_replay.flow_ssrc(), g_replay.count(),
+            g_replay.duration_ns() / 1e9);
+
     thread t1(endpoint_thread);
 
     while (true)
@@ -222,16 +754,37 @@ int main(int argc, char *argv[])
                 break;
 
             } else {
-                printf("error\n");
+                LOG(log_error, "sigtimedwait failed: %s", strerror(errno));
+                Logger::stop();
                 exit(EXIT_FAILURE);
             }
         }
+        int cmd = info.si_value.sival_int & 0xff;
+        if (cmd == cmd_release) {
+            endThread();
+            break;
+        }
+        if (cmd == cmd_log_level) {
+            Logger::set_level((log_level)(info.si_value.sival_int >> 8));
+            continue;
+        }
+        // the new configuration, copied as long as it is locked
+        Data new_conf;
         shared_list.lock();
-        Data *new_conf = shared_list.fetch_element(conf.port);
+        Data *data = shared_list.fetch_element(conf.port);
+        if (data)
+            memcpy(&new_conf, data, sizeof(Data));
         shared_list.unlock();
+        if (!data) {
+            // our entry is gone: as good as released
+            LOG(log_warning, "Reused, but not in the registry: released");
+            endThread();
+            break;
+        }
         {
             lock_guard<mutex> lk(cv_m);
-            memcpy(&conf, new_conf, sizeof(Data));
+            memcpy(&conf, &new_conf, sizeof(Data));
+            b_reused = true;
             // cout << "new signal\n";
         }
 
@@ -243,4 +796,5 @@ int main(int argc, char *argv[])
     shared_list.remove_element(conf.port);
     shared_list.unlock();
     delete g_pInfluxdb;
+    Logger::stop();
 }
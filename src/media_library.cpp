@@ -0,0 +1,305 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include "media_library.h"
+#include "logger.h"
+
+#define WAV_PCM         1
+#define WAV_RATE        8000
+#define WAV_CHANNELS    1
+#define WAV_BITS        16
+
+static inline uint32_t le32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint16_t le16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+// the PCM of a WAVE file, if in the library's format
+static bool wav_pcm(const std::string& path, size_t *offset, size_t *size, std::string& error)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        error = strerror(errno);
+        return false;
+    }
+    struct stat st;
+    uint8_t hdr[16];
+    bool fmt_ok = false;
+    error = "not a WAVE file";
+    if (fstat(fd, &st) == -1 || pread(fd, hdr, 12, 0) != 12 ||
+        memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4)) {
+        close(fd);
+        return false;
+    }
+
+    // chunks: id, size, data padded to 16 bits
+    for (off_t pos = 12; pos + 8 <= st.st_size; ) {
+        if (pread(fd, hdr, 8, pos) != 8)
+            break;
+        size_t len = le32(hdr + 4);
+        pos += 8;
+        if (!memcmp(hdr, "fmt ", 4)) {
+            if (len < 16 || pread(fd, hdr, 16, pos) != 16)
+                break;
+            if (le16(hdr) != WAV_PCM || le16(hdr + 2) != WAV_CHANNELS ||
+                le32(hdr + 4) != WAV_RATE || le16(hdr + 14) != WAV_BITS) {
+                error = "not PCM 16-bit, mono, 8000 Hz";
+                break;
+            }
+            fmt_ok = true;
+        } else if (!memcmp(hdr, "data", 4)) {
+            if (!fmt_ok)
+                break;
+            *offset = pos;
+            *size = std::min<size_t>(len, st.st_size - pos) & ~1;
+            close(fd);
+            if (*size == 0) {
+                error = "no audio";
+                return false;
+            }
+            error.clear();
+            return true;
+        }
+        pos += len + (len & 1);
+    }
+    close(fd);
+    return false;
+}
+
+MediaLibrary::~MediaLibrary()
+{
+    for (auto& source : sources)
+        if (source.second.loaded)
+            unload(source.first, source.second);
+}
+
+std::string MediaLibrary::shm_name(const std::string& prefix, const std::string& name)
+{
+    return prefix + "." + name;
+}
+
+// letters, digits, '-' and '_'; fits Data.source
+bool MediaLibrary::valid_name(const std::string& name)
+{
+    if (name.empty() || name.size() >= SOURCE_SZ)
+        return false;
+    for (char c : name)
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_')
+            return false;
+    return true;
+}
+
+bool MediaLibrary::open(const std::string& dir, const std::string& prefix, size_t budget,
+                        std::string& error)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        error = dir + ": " + strerror(errno);
+        return false;
+    }
+    this->prefix = prefix;
+    this->budget = budget;
+    while (struct dirent *entry = readdir(d)) {
+        std::string file = entry->d_name;
+        if (file.size() <= 4 || file.compare(file.size() - 4, 4, ".wav"))
+            continue;
+        std::string name = file.substr(0, file.size() - 4);
+        Source source;
+        source.path = dir + "/" + file;
+        std::string reason;
+        if (!valid_name(name))
+            LOG(log_warning, "Media library: %s skipped: name not of [A-Za-z0-9_-], "
+                "up to %d characters", file.c_str(), SOURCE_SZ - 1);
+        else if (!wav_pcm(source.path, &source.offset, &source.size, reason))
+            LOG(log_warning, "Media library: %s skipped: %s", file.c_str(), reason.c_str());
+        else if (budget && source.size + sizeof(SourceHeader) > budget)
+            LOG(log_warning, "Media library: %s skipped: larger than the memory budget",
+                file.c_str());
+        else
+            sources[name] = source;
+    }
+    closedir(d);
+    if (sources.empty()) {
+        error = "no audio source in " + dir;
+        return false;
+    }
+    return true;
+}
+
+bool MediaLibrary::has(const std::string& name) const
+{
+    return sources.count(name) != 0;
+}
+
+// the file's PCM into a new shared memory object
+bool MediaLibrary::load(const std::string& name, Source& source, std::string& error)
+{
+    std::string shm = shm_name(prefix, name);
+    size_t size = sizeof(SourceHeader) + source.size;
+    int file = ::open(source.path.c_str(), O_RDONLY);
+    if (file == -1) {
+        error = source.path + ": " + strerror(errno);
+        return false;
+    }
+    shm_unlink(shm.c_str());            // left by a previous server
+    int fd = shm_open(shm.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd == -1 || ftruncate(fd, size) == -1) {
+        error = shm + ": " + strerror(errno);
+        if (fd != -1) {
+            ::close(fd);
+            shm_unlink(shm.c_str());
+        }
+        ::close(file);
+        return false;
+    }
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    bool ok = (addr != MAP_FAILED);
+    if (ok) {
+        SourceHeader *hdr = (SourceHeader *)addr;
+        ok = pread(file, hdr + 1, source.size, source.offset) == (ssize_t)source.size;
+        hdr->clock_rate = WAV_RATE;
+        hdr->channels = WAV_CHANNELS;
+        hdr->bits = WAV_BITS;
+        hdr->size = source.size;
+        hdr->magic = SOURCE_MAGIC;       // last: complete
+        munmap(addr, size);
+    }
+    ::close(file);
+    if (!ok) {
+        error = source.path + ": failed to load";
+        shm_unlink(shm.c_str());
+        return false;
+    }
+    source.loaded = true;
+    used += size;
+    LOG(log_info, "Media library: %s loaded (%zu bytes)", name.c_str(), source.size);
+    return true;
+}
+
+// the endpoints still playing it keep their mapping
+void MediaLibrary::unload(const std::string& name, Source& source)
+{
+    shm_unlink(shm_name(prefix, name).c_str());
+    source.loaded = false;
+    used -= sizeof(SourceHeader) + source.size;
+}
+
+// unload the least recently used sources without users, until needed
+// bytes fit the budget
+bool MediaLibrary::evict(size_t needed, const std::map<std::string, unsigned>& users)
+{
+    time_t now = time(NULL);
+    while (used + needed > budget) {
+        auto lru = sources.end();
+        for (auto s = sources.begin(); s != sources.end(); s++) {
+            auto u = users.find(s->first);
+            if (!s->second.loaded || (u != users.end() && u->second) ||
+                now - s->second.last_used < SOURCE_GRACE)
+                continue;
+            if (lru == sources.end() || s->second.last_used < lru->second.last_used)
+                lru = s;
+        }
+        if (lru == sources.end())
+            return false;
+        LOG(log_info, "Media library: %s unloaded, least recently used", lru->first.c_str());
+        unload(lru->first, lru->second);
+    }
+    return true;
+}
+
+bool MediaLibrary::acquire(const std::string& name, const std::map<std::string, unsigned>& users,
+                           std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m);
+    auto s = sources.find(name);
+    if (s == sources.end()) {
+        error = "Unknown source " + name;
+        return false;
+    }
+    Source& source = s->second;
+    if (!source.loaded) {
+        if (budget && !evict(sizeof(SourceHeader) + source.size, users)) {
+            error = "Media library over its memory budget: every source loaded is in use, or just acquired";
+            return false;
+        }
+        if (!load(name, source, error))
+            return false;
+    }
+    source.last_used = time(NULL);
+    return true;
+}
+
+std::vector<SourceInfo> MediaLibrary::list(const std::map<std::string, unsigned>& users) const
+{
+    std::lock_guard<std::mutex> lock(m);
+    std::vector<SourceInfo> infos;
+    for (const auto& s : sources) {
+        auto u = users.find(s.first);
+        infos.push_back(SourceInfo{s.first, s.second.size, s.second.loaded,
+                                   (u != users.end())? u->second : 0, s.second.last_used});
+    }
+    return infos;
+}
+
+size_t MediaLibrary::memory_used() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return used;
+}
+
+bool MediaSource::open(const std::string& shm_name, const std::string& name, std::string& error)
+{
+    close();
+    int fd = shm_open(shm_name.c_str(), O_RDONLY, 0);
+    if (fd == -1) {
+        error = shm_name + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SourceHeader))
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        error = shm_name + ": not a loaded source";
+        return false;
+    }
+    const SourceHeader *hdr = (const SourceHeader *)addr;
+    if (hdr->magic != SOURCE_MAGIC || hdr->bits != 16 || hdr->channels != 1 ||
+        hdr->size > st.st_size - sizeof(SourceHeader)) {
+        munmap(addr, st.st_size);
+        error = shm_name + ": not a loaded source";
+        return false;
+    }
+    map = (const uint8_t *)addr;
+    map_size = st.st_size;
+    source_name = name;
+    return true;
+}
+
+void MediaSource::close()
+{
+    if (map)
+        munmap((void *)map, map_size);
+    map = nullptr;
+    map_size = 0;
+    source_name.clear();
+}
+
+void MediaSource::swap(MediaSource& other)
+{
+    std::swap(map, other.map);
+    std::swap(map_size, other.map_size);
+    std::swap(source_name, other.source_name);
+}
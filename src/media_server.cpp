@@ -9,8 +9,23 @@
 #include <string>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sched.h>
 #include <atomic>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
 #include "shared_list.h"
+#include "host_stats.h"
+#include "cpu_placement.h"
+#include "cgroup.h"
+#include "logger.h"
+#include "call_plan.h"
+#include "media_library.h"
+#include "group_stats.h"
+#include "thread_stats.h"
 
 using namespace Pistache;
 using namespace std;
@@ -23,22 +38,275 @@ using namespace std;
 
 static string g_wavefile = "sample.wav";
 static string g_codec;
+static string g_replay;             // clients' pcap replay, instead of the wavefile
+static string g_replay_flow;
+static string g_replay_speed;
 static uint16_t g_port = PORT;
 static string g_shared_mem_name;
+static unsigned g_max_idle = 0;     // max idle endpoints; 0: unlimited
+static int g_idle_ttl = 0;          // idle endpoints' lifetime (sec); 0: unlimited
+static size_t g_queue_max = 1000;   // max queued tasks
+static double g_spawn_rate = 0;     // max spawns per sec; 0: unlimited
+static int g_max_streams = 0;       // admission: max active streams; 0: unlimited
+static double g_min_cpu_idle = 0;   // admission: min CPU idle (%)
+static HostStats g_host_stats;
+static CpuPlacement g_placement;    // endpoints' CPUs
+static int g_rt_prio = 0;           // endpoints' SCHED_FIFO priority; 0: none
+static Cgroup g_server_cgroup;      // media_server itself
+static Cgroup g_endpoints_cgroup;   // all the endpoints
+static bool g_endpoint_cgroups = false;     // a cgroup per endpoint
+static bool g_warm_restart = false; // adopt the endpoints of a previous server
+static unsigned g_ptime = 0;        // endpoints' default packet time (ms); 0: the codec's
+static bool g_dtx = false;          // endpoints' default DTX
+static bool g_kernel_ts = false;    // endpoints' kernel timestamps
+static bool g_owd = false;          // endpoints' one-way delay
+static string g_rtcp_xr;            // endpoints' RTCP-XR mode; empty: off
+static bool g_fast_start = false;   // endpoints' fast-start mode
+static string g_srtp_key;           // preshared SRTP master key and salt, base64
+static MediaLibrary g_library;      // audio sources, selected per /stream
+static GroupStats g_groups;         // quality rollups, per /stream's tag
+
+// The endpoints' media and telemetry settings: the default profile, of
+// -p, -w and -c, and those of -V, on a port of their own or selected by
+// /stream's profile=. All share the registry, the worker and the library
+struct Profile {
+    string name;
+    uint16_t port;                  // HTTP; 0: none of its own
+    string codec;
+    string wavefile;
+    string influx_url;              // empty: the server's environment's
+    string influx_org;
+    string influx_bucket;
+    string influx_token;
+};
+static vector<Profile> g_profiles;  // [0]: the default one; set before the threads start
+
+static const Profile* find_profile(const char *name) {
+    for (const Profile& profile : g_profiles)
+        if (profile.name == name)
+            return &profile;
+    return NULL;
+}
+
+typedef chrono::steady_clock Clock;
+
+struct Task {
+    Data data;
+    Clock::time_point queued;
+};
+
+// Token bucket, for the spawns' rate
+class TokenBucket {
+    double rate;
+    double burst;
+    double tokens;
+    Clock::time_point last;
+
+public:
+    TokenBucket(double rate) : rate(rate), burst(max(rate, 1.0)), tokens(burst),
+        last(Clock::now()) {}
+
+    // take a token; if none is available, return the time to wait for one
+    Clock::duration take() {
+        if (rate <= 0) return Clock::duration::zero();
+        Clock::time_point now = Clock::now();
+        tokens = min(burst, tokens + chrono::duration<double>(now - last).count() * rate);
+        last = now;
+        if (tokens >= 1) {
+            tokens--;
+            return Clock::duration::zero();
+        }
+        return chrono::duration_cast<Clock::duration>(
+            chrono::duration<double>((1 - tokens) / rate));
+    }
+};
+
+// Queue lane statistics
+struct LaneStats {
+    unsigned long tasks = 0;
+    size_t max_depth = 0;
+    Clock::duration wait_sum = Clock::duration::zero();
+    Clock::duration wait_max = Clock::duration::zero();
+
+    void popped(const Task& task) {
+        Clock::duration wait = Clock::now() - task.queued;
+        tasks++;
+        wait_sum += wait;
+        wait_max = max(wait_max, wait);
+    }
+};
 
 // Global variables for thread communication
-queue<Data> taskQueue;
+// Reuses of existing endpoints take priority over spawns of new ones
+queue<Task> reuseQueue;
+queue<Task> spawnQueue;
+LaneStats reuseStats, spawnStats;    // protected by queueMutex
 mutex queueMutex;
 condition_variable queueCV;
+atomic<unsigned long> g_rejected{0};
+atomic<unsigned long> g_rejected_load{0};
+atomic<int> g_spawns_admitted{0};   // queued or spawning, not yet in the registry
 atomic<bool> b_running{true};
 
-sigval value;
+// Idle endpoints management
+mutex idleMutex;
+condition_variable idleCV;
+atomic<unsigned long> g_spawns{0};
+atomic<unsigned long> g_reuses{0};
+atomic<unsigned long> g_released{0};
+atomic<unsigned long> g_evicted_ttl{0};
+atomic<unsigned long> g_evicted_lru{0};
+
+// Children supervision
+mutex childrenMutex;
+struct Child {
+    chrono::steady_clock::time_point spawned;
+    int port;
+};
+map<pid_t, Child> g_children;
+atomic<unsigned long> g_exits{0};
+atomic<unsigned long> g_exit_failures{0};
+atomic<unsigned long> g_exit_signaled{0};
+atomic<unsigned long> g_exit_cleaned{0};       // registry entries left behind
+atomic<unsigned long long> g_lifetime_ms{0};    // sum of the children's lifetimes
+
+// /status long-polls, waiting for registry changes
+#define STATUS_POLL_MS 50
+#define STATUS_MAX_WAIT 30          // sec
+#define STATUS_MAX_EVENTS 1000      // per reply
+struct StatusWaiter {
+    unsigned long long since;
+    bool json;
+    Clock::time_point deadline;
+    Http::ResponseWriter response;
+};
+mutex waitersMutex;
+list<StatusWaiter> g_status_waiters;
+
+// SIPp-free load, from a call plan
+CallPlan g_plan;
+
+// send a command to an endpoint, with a real-time signal
+int send_command(pid_t pid, ep_command cmd, int arg = 0) {
+    sigval value;
+    value.sival_int = cmd | (arg << 8);
+    return sigqueue(pid, SIGRTMIN, value);
+}
+
+// tell an endpoint to exit; it removes itself from the registry.
+// Registry should be locked.
+void release_endpoint(SharedList& shared_list, Data *data) {
+    data->state = ep_released;
+    shared_list.touch(data);
+    if (send_command(data->pid, cmd_release) == -1) {
+        LOG(log_warning, "Non-existing process: {%s }", shared_list.print_element(data));
+        shared_list.remove_element(data->port);
+    }
+}
+
+// an endpoint's process is alive (and not a reused pid)
+bool endpoint_alive(pid_t pid) {
+    if (kill(pid, 0) == -1 && errno == ESRCH)
+        return false;
+
+    char comm[32] = "";
+    string path = "/proc/" + to_string(pid) + "/comm";
+    FILE *f = fopen(path.c_str(), "r");
+    if (f) {
+        if (!fgets(comm, sizeof(comm), f))
+            comm[0] = 0;
+        fclose(f);
+    }
+    return strncmp(comm, CLIENT, strlen(CLIENT)) == 0;
+}
+
+// Remove the adopted endpoints - not our children - once they have died
+void check_adopted(SharedList& shared_list) {
+    static Data *elements[MAX_NODES];
+    vector<pair<int, pid_t>> adopted;     // port, pid
+
+    // the endpoints that are not children, probed out of the locks; the
+    // registry's lock first, as in workerThread
+    shared_list.lock();
+    {
+        lock_guard<mutex> lock(childrenMutex);
+        int count = shared_list.fetch_elements(elements, MAX_NODES);
+        for (int i = 0; i < count; i++)
+            if (!g_children.count(elements[i]->pid))
+                adopted.emplace_back(elements[i]->port, elements[i]->pid);
+    }
+    shared_list.unlock();
+    vector<pair<int, pid_t>> dead;
+    for (const auto& endpoint : adopted)
+        if (!endpoint_alive(endpoint.second))
+            dead.push_back(endpoint);
+    if (dead.empty())
+        return;
+
+    shared_list.lock();
+    for (const auto& endpoint : dead) {
+        // unless its port was taken meanwhile
+        Data *data = shared_list.fetch_element(endpoint.first);
+        if (data && data->pid == endpoint.second) {
+            LOG(log_info, "Adopted endpoint died: {%s }", shared_list.print_element(data));
+            shared_list.remove_element(data->port);
+            g_exit_cleaned++;
+        }
+    }
+    shared_list.unlock();
+}
 
-void sigchld_handler(int sig) {
-    // terminate the exited spawned processes - avoid zombies creation
+// the cgroup of an endpoint, when a cgroup per endpoint
+Cgroup endpoint_cgroup(int port) {
+    return g_endpoints_cgroup.child("ep_" + to_string(port));
+}
+
+// Reap the exited children - avoid zombies creation - and remove
+// from the registry the entries they have left behind
+void reap_children(SharedList& shared_list) {
+    static Data *elements[MAX_NODES];
     pid_t pid;
-    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
-        cout << "Child of PID " << pid << " terminated\n";
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        long long lifetime = -1;
+        {
+            lock_guard<mutex> lock(childrenMutex);
+            auto child = g_children.find(pid);
+            if (child != g_children.end()) {
+                lifetime = chrono::duration_cast<chrono::milliseconds>(
+                    chrono::steady_clock::now() - child->second.spawned).count();
+                if (g_endpoint_cgroups)
+                    endpoint_cgroup(child->second.port).remove();
+                g_children.erase(child);
+            }
+        }
+
+        g_exits++;
+        if (lifetime > 0)
+            g_lifetime_ms += lifetime;
+        if (WIFSIGNALED(status))
+            g_exit_signaled++;
+        else if (WEXITSTATUS(status) != 0)
+            g_exit_failures++;
+
+        shared_list.lock();
+        int count = shared_list.fetch_elements(elements, MAX_NODES);
+        for (int i = 0; i < count; i++) {
+            if (elements[i]->pid == pid) {
+                shared_list.remove_element(elements[i]->port);
+                g_exit_cleaned++;
+                break;
+            }
+        }
+        shared_list.unlock();
+
+        if (WIFSIGNALED(status))
+            LOG(log_warning, "Child of PID %d killed by signal %d, lifetime %lld ms",
+                pid, WTERMSIG(status), lifetime);
+        else
+            LOG(log_debug, "Child of PID %d exited with status %d, lifetime %lld ms",
+                pid, WEXITSTATUS(status), lifetime);
     }
 }
 
@@ -52,125 +320,782 @@ string setenvvar(string var, const char* name) {
         return var + "=" + string(env);
 }
 
+// a profile's InfluxDB setting, or the environment's
+string profile_env(string var, const string& value, const char* name) {
+    return (value.empty())? setenvvar(var, name) : var + "=" + value;
+}
+
 pid_t launch_background(Data &data) {
+    const Profile *profile = find_profile(data.profile);
+    if (!profile)
+        profile = &g_profiles[0];
+    // the command line and environment, built before fork: the child of a
+    // threaded process must not allocate
+    string str_port = to_string(data.port);
+    string str_dport = to_string(data.dest_port);
+    string str_dur = to_string(data.duration);
+    string server = (data.client)? "" : "--server";
+    string bidir = (data.bidir)? "--bidir" : "";
+    string rt_prio = (g_rt_prio)? "--rt-priority=" + to_string(g_rt_prio) : "";
+    string log_level = string("--log-level=") + Logger::level_name(Logger::level());
+    string ptime = (data.ptime)? "--ptime=" + to_string(data.ptime) : "";
+    string dtx = (data.dtx)? "--dtx" : "";
+    string kernel_ts = (g_kernel_ts)? "--kernel-ts" : "";
+    string owd = (g_owd)? "--owd" : "";
+    string rtcp_xr = (g_rtcp_xr.empty())? "" : "--rtcp-xr=" + g_rtcp_xr;
+    string fast_start = (g_fast_start)? "--fast-start" : "";
+    string replay = (g_replay.empty())? "" : "--replay=" + g_replay;
+    string replay_flow = (g_replay_flow.empty())? "" : "--replay-flow=" + g_replay_flow;
+    string replay_speed = (g_replay_speed.empty())? "" : "--replay-speed=" + g_replay_speed;
+    char *const argv[] =
+    {
+        (char*)CLIENT,
+        (char*)"--local-port",  STR2CHAR(str_port),
+        (char*)"--remote-addr", data.dest_address,
+        (char*)"--remote-port", STR2CHAR(str_dport),
+        (char*)"--duration",    STR2CHAR(str_dur),
+        (char*)"--wavefile",    STR2CHAR(profile->wavefile),
+        (char*)"--codec",       STR2CHAR(profile->codec),
+        (char*)"--shared-mem",  STR2CHAR(g_shared_mem_name),
+        STR2CHAR(server),
+        STR2CHAR(bidir),
+        STR2CHAR(rt_prio),
+        STR2CHAR(log_level),
+        STR2CHAR(ptime),
+        STR2CHAR(dtx),
+        STR2CHAR(replay),
+        STR2CHAR(replay_flow),
+        STR2CHAR(replay_speed),
+        STR2CHAR(kernel_ts),
+        STR2CHAR(owd),
+        STR2CHAR(rtcp_xr),
+        STR2CHAR(fast_start),
+        NULL
+    };
+
+    string _url = profile_env("influx_URL", profile->influx_url, "URL");
+    string _token = profile_env("influx_token", profile->influx_token, "token");
+    string _org = profile_env("influx_org", profile->influx_org, "org");
+    string _bucket = profile_env("influx_bucket", profile->influx_bucket, "bucket");
+
+    char *const envp[] =
+    {
+        STR2CHAR(_url),
+        STR2CHAR(_token),
+        STR2CHAR(_org),
+        STR2CHAR(_bucket),
+        NULL
+    };
+
+    Cgroup cgroup = (g_endpoint_cgroups)? endpoint_cgroup(data.port) : g_endpoints_cgroup;
+    int procs_fd = cgroup.open_procs();
+    if (procs_fd == -1 && cgroup.valid())
+        LOG(log_warning, "Cannot open %s/cgroup.procs: %s", cgroup.get_path().c_str(), strerror(errno));
     pid_t pid = fork();
     if (pid == -1) {
-        perror("fork failed");
+        LOG(log_error, "fork failed: %s", strerror(errno));
+        if (procs_fd != -1)
+            close(procs_fd);
         return -1;
     } else if (pid == 0) {
         // Child process
         setsid(); // Start new session
-        string str_port = to_string(data.port);
-        string str_dport = to_string(data.dest_port);
-        string str_dur = to_string(data.duration);
-        string server = (data.client)? "" : "--server";
-        char *const argv[] =
-        {
-            (char*)CLIENT,
-            (char*)"--local-port",  STR2CHAR(str_port),
-            (char*)"--remote-addr", data.dest_address,
-            (char*)"--remote-port", STR2CHAR(str_dport),
-            (char*)"--duration",    STR2CHAR(str_dur),
-            (char*)"--wavefile",    STR2CHAR(g_wavefile),
-            (char*)"--codec",       STR2CHAR(g_codec),
-            (char*)"--shared-mem",  STR2CHAR(g_shared_mem_name),
-            STR2CHAR(server),
-            NULL
-        };
-
-        string _url = STR2CHAR( setenvvar("influx_URL", "URL") );
-        string _token = setenvvar("influx_token", "token");
-        string _org = setenvvar("influx_org", "org");
-        string _bucket = setenvvar("influx_bucket", "bucket");
-
-        char *const envp[] =
-        {
-            STR2CHAR(_url),
-            STR2CHAR(_token),
-            STR2CHAR(_org),
-            STR2CHAR(_bucket),
-            NULL
-        };
+        // into its cgroup, and onto its CPU, before exec; async-signal-safe
+        // calls only, in the child of a threaded process
+        if (procs_fd != -1) {
+            if (write(procs_fd, "0", 1) != 1)
+                Logger::write_raw("attach to the endpoints' cgroup failed\n");
+            close(procs_fd);
+        }
+        if (data.cpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(data.cpu, &cpus);
+            if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1)
+                Logger::write_raw("sched_setaffinity failed\n");
+        }
+        // the server's signals are for its signalfd, not the endpoint's
+        sigset_t empty;
+        sigemptyset(&empty);
+        sigprocmask(SIG_SETMASK, &empty, NULL);
 
         execvpe(CLIENT, argv, envp);
-        perror("exec failed");
+        // only async-signal-safe calls, in the child of a threaded process
+        Logger::write_raw("exec " CLIENT " failed\n");
         _exit(1);
     }
+    if (procs_fd != -1)
+        close(procs_fd);
     // Parent returns child PID
     return pid;
 }
 
 // Worker thread function
 void workerThread(SharedList& shared_list) {
+    set_thread_name("ms-worker");
+    TokenBucket spawn_bucket(g_spawn_rate);
+
     while (b_running) {
         unique_lock<mutex> lock(queueMutex);
 
-        // Wait for a task or shutdown signal
-        queueCV.wait(lock, [] {
-            return !taskQueue.empty() || !b_running;
-        });
+        // Wait for a reuse task, a spawn task allowed by the spawns' rate,
+        // or shutdown signal
+        queue<Task> *lane = NULL;
+        while (b_running) {
+            if (!reuseQueue.empty()) {
+                lane = &reuseQueue;
+                break;
+            }
+            if (!spawnQueue.empty()) {
+                Clock::duration wait = spawn_bucket.take();
+                if (wait == Clock::duration::zero()) {
+                    lane = &spawnQueue;
+                    break;
+                }
+                queueCV.wait_for(lock, wait);
+            } else
+                queueCV.wait(lock);
+        }
 
         if (!b_running) break;
 
         // Get the next task
-        Data data = taskQueue.front();
-        taskQueue.pop();
+        Task task = lane->front();
+        lane->pop();
+        ((lane == &reuseQueue)? reuseStats : spawnStats).popped(task);
         lock.unlock();
+        Data data = task.data;
+        // a spawn counts against -S until it is in the registry, or dropped
+        struct Admitted {
+            bool spawn;
+            ~Admitted() { if (spawn) g_spawns_admitted--; }
+        } admitted{lane == &spawnQueue};
 
         // Core work
         shared_list.lock();
         Data* fetched_data = shared_list.fetch_element(data.port);
 
+        if (fetched_data && fetched_data->state == ep_released) {
+            // still holds the port, until it exits
+            LOG(log_info, "Endpoint being released: {%s }", shared_list.print_element(&data));
+            shared_list.unlock();
+            continue;
+        }
+        if (fetched_data && strcmp(fetched_data->profile, data.profile)) {
+            // taken by another profile's endpoint since queued
+            LOG(log_warning, "Port in use by profile %s: {%s }", fetched_data->profile,
+                shared_list.print_element(&data));
+            shared_list.unlock();
+            continue;
+        }
 
         if (fetched_data) {
             // update data of existing element, but keep the original pid
+            // and the endpoint's own figures
             data.pid = fetched_data->pid;
+            data.pool_used = fetched_data->pool_used;
+            data.reuse_cnt = fetched_data->reuse_cnt + 1;
+            data.cpu = fetched_data->cpu;
+            data.cpu_usec = fetched_data->cpu_usec;
+            data.mem_bytes = fetched_data->mem_bytes;
+            data.spawn_ns = fetched_data->spawn_ns;
+            data.srtp_cpu_ns = fetched_data->srtp_cpu_ns;
+            data.quality = fetched_data->quality;
+            memcpy(data.startup_us, fetched_data->startup_us, sizeof(data.startup_us));
             if (shared_list.update_element(&data) == ERROR)
-                cout << "Failed to update: {" << shared_list.print_element(&data) << " }\n";
+                LOG(log_error, "Failed to update: {%s }", shared_list.print_element(&data));
             else {
                 // notify the client process with a real-time signal
-                if (sigqueue(fetched_data->pid, SIGRTMIN, value) == -1) {
-                    cout << "Non-existing process: {" << shared_list.print_element(&data) << " }\n";
+                if (send_command(fetched_data->pid, cmd_reuse) == -1) {
+                    LOG(log_warning, "Non-existing process: {%s }", shared_list.print_element(&data));
                     if (shared_list.remove_element(fetched_data->port) == ERROR)
-                        cout << "Failed to remove : {" << shared_list.print_element(&data) << " }\n";
+                        LOG(log_error, "Failed to remove : {%s }", shared_list.print_element(&data));
                     fetched_data = NULL;
-                }
+                } else
+                    g_reuses++;
 
             }
         }
         if (fetched_data == NULL) {
             // call new process
+            data.reuse_cnt = 0;
+            data.cpu = g_placement.next_cpu();
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            data.spawn_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+            // a child known before the reaper can see it exit
+            unique_lock<mutex> children_lock(childrenMutex);
             pid_t pid = launch_background(data);
             if (pid != -1) {
+                g_children[pid] = Child{chrono::steady_clock::now(), data.port};
+                children_lock.unlock();
+                g_spawns++;
                 data.pid = pid;
                 if (shared_list.add_element(&data) == ERROR)
-                    cout << "Failed to add: {" << shared_list.print_element(&data) << " }\n";
+                    LOG(log_error, "Failed to add: {%s }", shared_list.print_element(&data));
             }
         }
         shared_list.unlock();
 
     }
-    cout << "\nWorker Thread ended\n";
+    LOG(log_info, "Worker Thread ended");
+}
+
+// Release the idle endpoints that outlived their TTL, and then
+// the least recently used ones, above the max idle endpoints
+void evict_idle(SharedList& shared_list) {
+    static Data *elements[MAX_NODES];
+    vector<Data*> idle;
+    time_t now = time(NULL);
+
+    shared_list.lock();
+    int count = shared_list.fetch_elements(elements, MAX_NODES);
+    for (int i = 0; i < count; i++) {
+        Data *data = elements[i];
+        if (data->state != ep_idle)
+            continue;
+        if (g_idle_ttl && now - data->idle_since >= g_idle_ttl) {
+            release_endpoint(shared_list, data);
+            g_evicted_ttl++;
+        } else
+            idle.push_back(data);
+    }
+
+    if (g_max_idle && idle.size() > g_max_idle) {
+        sort(idle.begin(), idle.end(), [](const Data *a, const Data *b) {
+            return a->idle_since < b->idle_since;
+        });
+        for (size_t i = 0; i < idle.size() - g_max_idle; i++) {
+            release_endpoint(shared_list, idle[i]);
+            g_evicted_lru++;
+        }
+    }
+    shared_list.unlock();
+}
+
+#define USAGE_CPU_STEP 1000000      // usec of CPU
+#define USAGE_MEM_STEP (4 << 20)    // bytes
+
+// Copy the endpoints' resource usage, from their cgroups, to the registry.
+// It is journaled only on a change of USAGE_CPU_STEP or USAGE_MEM_STEP,
+// not to flood the journal with an update per endpoint per second
+void update_endpoints_usage(SharedList& shared_list) {
+    static Data *elements[MAX_NODES];
+    static map<int, CgroupUsage> journaled;     // per port
+    vector<int> ports;
+
+    shared_list.lock();
+    int count = shared_list.fetch_elements(elements, MAX_NODES);
+    for (int i = 0; i < count; i++)
+        ports.push_back(elements[i]->port);
+    shared_list.unlock();
+
+    // read the cgroups out of the registry lock
+    vector<CgroupUsage> usage;
+    for (int port : ports)
+        usage.push_back(Cgroup(g_endpoints_cgroup.get_path() + "/ep_" + to_string(port)).usage());
+
+    map<int, CgroupUsage> still;
+    shared_list.lock();
+    for (size_t i = 0; i < ports.size(); i++) {
+        Data *data = shared_list.fetch_element(ports[i]);
+        if (!data)
+            continue;
+        data->cpu_usec = usage[i].cpu_usec;
+        data->mem_bytes = usage[i].memory;
+        CgroupUsage &last = journaled[ports[i]];
+        if (usage[i].cpu_usec - last.cpu_usec >= USAGE_CPU_STEP ||
+            llabs((long long)(usage[i].memory - last.memory)) >= USAGE_MEM_STEP) {
+            shared_list.touch(data);
+            last = usage[i];
+        }
+        still[ports[i]] = last;
+    }
+    shared_list.unlock();
+    journaled.swap(still);      // without the endpoints gone
+}
+
+// Roll the endpoints' quality reports up per group tag, following the
+// registry's journal: a report is new when the endpoint's count of them
+// increases. Once behind the journal, the reports in between are missed
+#define GROUP_EVENTS 1024           // per journal read
+void update_groups(SharedList& shared_list) {
+    static vector<JournalEvent> events(GROUP_EVENTS);
+    static vector<Data> elements(MAX_NODES);
+    static unsigned long long seq;
+    static bool following = false;
+    static map<pid_t, unsigned> reports;        // seen, per endpoint
+
+    int count;
+    do {
+        unsigned long long last;
+        shared_list.lock();
+        count = (following)? shared_list.changes(seq, events.data(), GROUP_EVENTS, &last) : -1;
+        if (count < 0) {
+            // from a snapshot on: its reports are not new
+            int elements_count;
+            seq = shared_list.snapshot(elements.data(), MAX_NODES, &elements_count);
+            shared_list.unlock();
+            if (following)
+                LOG(log_warning, "Group rollups behind the registry's journal: reports missed");
+            reports.clear();
+            for (int i = 0; i < elements_count; i++)
+                reports[elements[i].pid] = elements[i].quality.reports;
+            following = true;
+            return;
+        }
+        shared_list.unlock();
+        seq = last;
+
+        time_t now = time(NULL);
+        for (int i = 0; i < count; i++) {
+            const Data& data = events[i].data;
+            if (events[i].op == jr_remove) {
+                reports.erase(data.pid);
+                continue;
+            }
+            unsigned& seen = reports[data.pid];
+            if (data.quality.reports > seen && data.tag[0])
+                g_groups.add(data.tag, data.quality.tx, data.quality.rx, now);
+            seen = data.quality.reports;
+        }
+    } while (count == GROUP_EVENTS);
+}
+
+// Periodic housekeeping: idle endpoints, host's load, endpoints' usage and
+// quality rollups
+void housekeepingThread(SharedList& shared_list) {
+    set_thread_name("ms-housekeep");
+    unique_lock<mutex> lock(idleMutex);
+    while (b_running) {
+        idleCV.wait_for(lock, chrono::seconds(1));
+        if (!b_running) break;
+        if (g_max_idle || g_idle_ttl)
+            evict_idle(shared_list);
+        g_host_stats.sample();
+        if (g_endpoint_cgroups)
+            update_endpoints_usage(shared_list);
+        if (g_warm_restart)
+            check_adopted(shared_list);
+        update_groups(shared_list);
+    }
+}
+
+// Set up a cgroup subtree: media_server in "server", the endpoints in
+// "endpoints" (and optionally in a child cgroup each), with limits.
+// The own cgroup cannot host processes, once it enables controllers.
+bool setup_cgroups(double cpu_limit, unsigned long long memory_limit) {
+    Cgroup own = Cgroup::self();
+    g_server_cgroup = own.child("server");
+    if (!g_server_cgroup.attach(0)) {
+        LOG(log_error, "Failed to move media_server to its cgroup: %s", strerror(errno));
+        return false;
+    }
+    if (!own.enable_controllers("+cpu +memory")) {
+        LOG(log_error, "Failed to enable cpu and memory controllers: %s", strerror(errno));
+        return false;
+    }
+    g_endpoints_cgroup = own.child("endpoints");
+    if (!g_endpoints_cgroup.valid()) {
+        LOG(log_error, "Failed to create the endpoints' cgroup: %s", strerror(errno));
+        return false;
+    }
+    if (g_endpoint_cgroups && !g_endpoints_cgroup.enable_controllers("+cpu +memory")) {
+        LOG(log_error, "Failed to enable cpu and memory controllers per endpoint: %s", strerror(errno));
+        return false;
+    }
+    if (cpu_limit > 0 && !g_endpoints_cgroup.set_cpu_limit(cpu_limit)) {
+        LOG(log_error, "Failed to set the endpoints' CPU limit: %s", strerror(errno));
+        return false;
+    }
+    if (memory_limit > 0 && !g_endpoints_cgroup.set_memory_limit(memory_limit)) {
+        LOG(log_error, "Failed to set the endpoints' memory limit: %s", strerror(errno));
+        return false;
+    }
+    LOG(log_info, "Endpoints cgroup: %s", g_endpoints_cgroup.get_path().c_str());
+    return true;
+}
+
+// count the registry's endpoints per state
+int count_states(SharedList& shared_list, int states[3]) {
+    static Data *elements[MAX_NODES];
+    states[ep_active] = states[ep_idle] = states[ep_released] = 0;
+
+    shared_list.lock();
+    int count = shared_list.fetch_elements(elements, MAX_NODES);
+    for (int i = 0; i < count; i++)
+        if (elements[i]->state <= ep_released)
+            states[elements[i]->state]++;
+    shared_list.unlock();
+    return count;
+}
+
+// the reason to reject a new stream; empty if it can be admitted
+string overloaded(SharedList& shared_list) {
+    if (g_max_streams) {
+        int states[3];
+        count_states(shared_list, states);
+        if (states[ep_active] + g_spawns_admitted >= g_max_streams)
+            return "Overloaded: max streams reached";
+    }
+    if (g_min_cpu_idle > 0 && g_host_stats.load().cpu_idle < g_min_cpu_idle)
+        return "Overloaded: CPU idle below minimum";
+    return "";
+}
+
+enum enqueue_rc {
+    enq_ok = 0,
+    enq_overloaded,
+    enq_queue_full,
+    enq_conflict,       // the port's endpoint is of another profile
+};
+
+// Admit a stream, and queue its task: existing endpoints are reused
+// through the priority lane. On rejection, reason and the seconds to
+// retry after are set.
+enqueue_rc enqueue_task(SharedList& shared_list, const Data& data, string& reason, long& retry) {
+    shared_list.lock();
+    Data *fetched_data = shared_list.fetch_element(data.port);
+    bool reuse = fetched_data && fetched_data->state != ep_released;
+    bool new_stream = !fetched_data || fetched_data->state != ep_active;
+    string other = (reuse && strcmp(fetched_data->profile, data.profile))?
+        fetched_data->profile : "";
+    shared_list.unlock();
+
+    if (!other.empty()) {
+        reason = "Port " + to_string(data.port) + " in use by profile " + other;
+        return enq_conflict;
+    }
+
+    // Admission control
+    reason = (new_stream)? overloaded(shared_list) : "";
+    if (!reason.empty()) {
+        g_rejected_load++;
+        retry = 1;
+        return enq_overloaded;
+    }
+
+    // Add task to worker queue, unless full
+    {
+        lock_guard<mutex> lock(queueMutex);
+        size_t depth = reuseQueue.size() + spawnQueue.size();
+        if (depth >= g_queue_max) {
+            g_rejected++;
+            // the time to drain the spawns, at their rate
+            retry = (g_spawn_rate > 0)? (long)(spawnQueue.size() / g_spawn_rate) + 1 : 1;
+            reason = "Task queue full";
+            return enq_queue_full;
+        }
+        queue<Task> &lane = (reuse)? reuseQueue : spawnQueue;
+        lane.push(Task{data, Clock::now()});
+        if (!reuse)
+            g_spawns_admitted++;
+        LaneStats &stats = (reuse)? reuseStats : spawnStats;
+        stats.max_depth = max(stats.max_depth, lane.size());
+    }
+    queueCV.notify_one();
+    return enq_ok;
+}
+
+// the endpoints playing each source of the library, or queued to
+map<string, unsigned> source_users(SharedList& shared_list) {
+    static Data *elements[MAX_NODES];
+    map<string, unsigned> users;
+    shared_list.lock();
+    int count = shared_list.fetch_elements(elements, MAX_NODES);
+    for (int i = 0; i < count; i++)
+        if (elements[i]->source[0])
+            users[elements[i]->source]++;
+    shared_list.unlock();
+
+    lock_guard<mutex> lock(queueMutex);
+    for (queue<Task> *lane : {&reuseQueue, &spawnQueue}) {
+        queue<Task> tasks = *lane;
+        for (; !tasks.empty(); tasks.pop())
+            if (tasks.front().data.source[0])
+                users[tasks.front().data.source]++;
+    }
+    return users;
+}
+
+static const char* state_name(unsigned short state) {
+    static const char *names[] = {"active", "idle", "released"};
+    return (state <= ep_released)? names[state] : "unknown";
+}
+
+// a JSON string's content; the address comes from the /stream query
+static string json_escape(const char *str) {
+    string out;
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            out += '\\';
+        if ((unsigned char)*str >= ' ')
+            out += *str;
+    }
+    return out;
+}
+
+string json_element(const Data& data) {
+    char out[896];
+    snprintf(out, sizeof(out),
+        "{\"port\":%d,\"dest_port\":%d,\"dest_address\":\"%s\",\"duration\":%d,"
+        "\"pid\":%d,\"client\":%d,\"bidir\":%d,\"pool_used\":%u,\"state\":\"%s\","
+        "\"reuse_cnt\":%u,\"idle_since\":%ld,\"cpu\":%d,\"cpu_usec\":%llu,\"mem_bytes\":%llu,"
+        "\"ptime\":%u,\"dtx\":%u,\"pps\":%.1f,\"srtp\":\"%s\",\"srtp_cpu_ns\":%llu,"
+        "\"source\":\"%s\",\"profile\":\"%s\",\"tag\":\"%s\"}",
+        data.port, data.dest_port, json_escape(data.dest_address).c_str(), data.duration,
+        data.pid, data.client, data.bidir, data.pool_used, state_name(data.state),
+        data.reuse_cnt, (long)data.idle_since, data.cpu, data.cpu_usec, data.mem_bytes,
+        data.ptime, data.dtx, data.pps, json_escape(data.srtp).c_str(), data.srtp_cpu_ns,
+        json_escape(data.source).c_str(), json_escape(data.profile).c_str(),
+        json_escape(data.tag).c_str());
+
+    static const char *phases[SP_PHASES] = {"exec", "args", "registry", "influx", "pjlib",
+        "media", "codecs", "transport", "stream", "first_packet", "total"};
+    string startup = ",\"startup_us\":{";
+    for (int i = 0; i < SP_PHASES; i++)
+        startup += string((i)? ",\"" : "\"") + phases[i] + "\":" + to_string(data.startup_us[i]);
+    const ImpairProfile& impair = data.impair;
+    char impairment[256];
+    snprintf(impairment, sizeof(impairment),
+        ",\"impair\":{\"loss\":%.2f,\"burst\":%.1f,\"jitter_ms\":%u,\"jitter_dist\":\"%s\","
+        "\"reorder\":%.2f,\"dup\":%.2f,\"seed\":%u}",
+        impair.loss, impair.burst, impair.jitter_ms, jitter_dist_name(impair.jitter_dist),
+        impair.reorder, impair.dup, impair.seed);
+    return string(out, strlen(out) - 1) + startup + "}" + impairment + "}";
+}
+
+// reply with the registry changes after since, out of the journal
+void send_changes(SharedList& shared_list, unsigned long long since, bool json,
+                  Http::ResponseWriter& response) {
+    static const char *op_names[] = {"add", "update", "remove"};
+    static thread_local vector<JournalEvent> events(STATUS_MAX_EVENTS);
+    unsigned long long seq;
+
+    shared_list.lock();
+    int count = shared_list.changes(since, events.data(), STATUS_MAX_EVENTS, &seq);
+    shared_list.unlock();
+    if (count < 0) {
+        response.send(Http::Code::Gone,
+            "Changes since " + to_string(since) + " no longer journaled; take a snapshot\n");
+        return;
+    }
+
+    string output;
+    if (json) {
+        output = "{\"seq\":" + to_string(seq) + ",\"events\":[";
+        for (int i = 0; i < count; i++)
+            output += string((i)? "," : "") + "{\"seq\":" + to_string(events[i].seq) +
+                ",\"op\":\"" + op_names[events[i].op] + "\",\"endpoint\":" +
+                json_element(events[i].data) + "}";
+        output += "]}\n";
+    } else {
+        output = "seq: " + to_string(seq) + "\n";
+        for (int i = 0; i < count; i++)
+            output += to_string(events[i].seq) + " " + op_names[events[i].op] + " " +
+                SharedList::print_element(&events[i].data) + "\n";
+    }
+    response.headers().addRaw(Http::Header::Raw("X-Registry-Seq", to_string(seq)));
+    response.send(Http::Code::Ok, output);
+}
+
+// Answer the /status long-polls on a change, or when their wait is over
+void statusWaitThread(SharedList& shared_list) {
+    set_thread_name("ms-status");
+    while (b_running) {
+        this_thread::sleep_for(chrono::milliseconds(STATUS_POLL_MS));
+        unsigned long long seq = shared_list.journal_seq();
+        Clock::time_point now = Clock::now();
+
+        lock_guard<mutex> lock(waitersMutex);
+        for (auto waiter = g_status_waiters.begin(); waiter != g_status_waiters.end(); ) {
+            if (seq != waiter->since || now >= waiter->deadline || !b_running) {
+                send_changes(shared_list, waiter->since, waiter->json, waiter->response);
+                waiter = g_status_waiters.erase(waiter);
+            } else
+                waiter++;
+        }
+    }
+}
+
+// packet time: a multiple of G.711's 10 ms frames, up to 60 ms; 0: the codec's default
+static bool valid_ptime(unsigned ptime) {
+    return ptime % 10 == 0 && ptime <= 60;
+}
+
+// the packetization profile of a request, ptime= (ms) and dtx=[0|1],
+// over the server's defaults
+static bool packetization(const Http::Uri::Query& query, unsigned short *ptime,
+                          unsigned short *dtx) {
+    int value = stoi(query.get("ptime").value_or(to_string(g_ptime)));
+    *ptime = value;
+    *dtx = (query.has("dtx"))? query.get("dtx").value_or("") != "0" : g_dtx;
+    return value >= 0 && valid_ptime(value);
+}
+
+#define SRTP_DEFAULT_SUITE "AES_CM_128_HMAC_SHA1_80"
+
+// SRTP crypto suites, and their master key and salt length (bytes)
+static const struct { const char *name; int key_len; } srtp_suites[] = {
+    {"AES_CM_128_HMAC_SHA1_80", 30},
+    {"AES_CM_128_HMAC_SHA1_32", 30},
+    {"AES_256_CM_HMAC_SHA1_80", 46},
+    {"AES_256_CM_HMAC_SHA1_32", 46},
+    {"AEAD_AES_128_GCM", 28},
+    {"AEAD_AES_256_GCM", 44},
+};
+
+// the length of base64 data, decoded; -1 if not base64
+static int base64_size(const string& b64) {
+    size_t n = b64.size(), pad = 0;
+    if (n == 0 || n % 4)
+        return -1;
+    while (pad < 2 && b64[n - 1 - pad] == '=')
+        pad++;
+    for (size_t i = 0; i < n - pad; i++)
+        if (!isalnum((unsigned char)b64[i]) && b64[i] != '+' && b64[i] != '/')
+            return -1;
+    return n / 4 * 3 - pad;
+}
+
+// the SRTP of a request, srtp[=SUITE] and srtp_key= (base64; by default
+// the preshared one); false, with the reason, if invalid
+static bool srtp_params(const Http::Uri::Query& query, Data *data, string& reason) {
+    if (!query.has("srtp"))
+        return true;
+    string suite = query.get("srtp").value_or("");
+    if (suite.empty() || suite == "1")
+        suite = SRTP_DEFAULT_SUITE;
+    int key_len = 0;
+    for (const auto& known : srtp_suites)
+        if (suite == known.name)
+            key_len = known.key_len;
+    if (!key_len) {
+        reason = "Unknown SRTP suite " + suite;
+        return false;
+    }
+
+    string key = query.get("srtp_key").value_or(g_srtp_key);
+    replace(key.begin(), key.end(), ' ', '+');      // an unescaped '+'
+    if (key.empty()) {
+        reason = "Missing srtp_key parameter, and no preshared key (-X)";
+        return false;
+    }
+    if (base64_size(key) != key_len) {
+        reason = "Wrong srtp_key: " + suite + " needs " + to_string(key_len) +
+                 " bytes of key and salt, in base64";
+        return false;
+    }
+    strncpy(data->srtp, suite.c_str(), sizeof(data->srtp) - 1);
+    strncpy(data->srtp_key, key.c_str(), sizeof(data->srtp_key) - 1);
+    return true;
+}
+
+// the impairment of a request's sent packets: loss=PCT[&burst=PKTS],
+// jitter=MS[&jitter_dist=DIST], reorder=PCT, dup=PCT, seed=N; false, with
+// the reason, if invalid
+static bool impair_params(const Http::Uri::Query& query, Data *data, string& reason) {
+    ImpairProfile& impair = data->impair;
+    impair.loss = stof(query.get("loss").value_or("0"));
+    impair.burst = stof(query.get("burst").value_or("1"));
+    int jitter = stoi(query.get("jitter").value_or("0"));
+    string dist_name = query.get("jitter_dist").value_or("normal");
+    int dist = jitter_dist_parse(dist_name.c_str());
+    impair.reorder = stof(query.get("reorder").value_or("0"));
+    impair.dup = stof(query.get("dup").value_or("0"));
+    impair.seed = stoul(query.get("seed").value_or("0"));
+    if (dist < 0) {
+        reason = "Unknown jitter_dist " + dist_name + ": uniform, normal or pareto";
+        return false;
+    }
+    if (jitter < 0 || jitter > 10000) {
+        reason = "Wrong jitter parameter: 0 to 10000 (ms)";
+        return false;
+    }
+    impair.jitter_ms = jitter;
+    impair.jitter_dist = dist;
+    const char *error = impair_check(&impair);
+    if (error) {
+        reason = string("Wrong impairment: ") + error;
+        return false;
+    }
+    return true;
 }
 
 class RestAPIHandler {
+    SharedList& shared_list;
+    const Profile& profile;         // of the port served
+
+    // the request's profile=, or the port's; NULL if unknown
+    const Profile* request_profile(const Http::Uri::Query& query) const {
+        auto name = query.get("profile");
+        return (name)? find_profile(name->c_str()) : &profile;
+    }
+
 public:
+    RestAPIHandler(SharedList& shared_list, const Profile& profile) :
+        shared_list(shared_list), profile(profile) {}
+
     void setupRoutes(Rest::Router& router) {
         using namespace Rest;
 
         // Add a task to the worker queue
         Routes::Get(router, "/stream", Routes::bind(&RestAPIHandler::addTask, this));
 
+        // Release an endpoint (e.g. on BYE)
+        Routes::Delete(router, "/stream", Routes::bind(&RestAPIHandler::releaseTask, this));
+
         // Get list status
         Routes::Get(router, "/status", Routes::bind(&RestAPIHandler::getStatus, this));
+
+        // Get endpoints' pool statistics
+        Routes::Get(router, "/stats", Routes::bind(&RestAPIHandler::getStats, this));
+
+        // Get the server's load and capacity
+        Routes::Get(router, "/load", Routes::bind(&RestAPIHandler::getLoad, this));
+
+        // Run, follow or stop a call plan
+        Routes::Post(router, "/plan", Routes::bind(&RestAPIHandler::startPlan, this));
+        Routes::Get(router, "/plan", Routes::bind(&RestAPIHandler::getPlan, this));
+        Routes::Delete(router, "/plan", Routes::bind(&RestAPIHandler::stopPlan, this));
+
+        // Get or set the log level, of the server and its endpoints
+        Routes::Get(router, "/log", Routes::bind(&RestAPIHandler::logLevel, this));
+
+        // Get the media library's sources
+        Routes::Get(router, "/library", Routes::bind(&RestAPIHandler::getLibrary, this));
+
+        // Get the server's profiles
+        Routes::Get(router, "/profiles", Routes::bind(&RestAPIHandler::getProfiles, this));
+
+        // Get the quality rollups, per group tag
+        Routes::Get(router, "/groups", Routes::bind(&RestAPIHandler::getGroups, this));
+
+        // Get the threads' CPU time, context switches and wakeups, of the
+        // server or of an endpoint
+        Routes::Get(router, "/threads", Routes::bind(&RestAPIHandler::getThreads, this));
     }
 
     void addTask(const Rest::Request& request, Http::ResponseWriter response) {
         try {
             // Parse input
-            Data data;
+            Data data = {};
             auto query = request.query();
+            const Profile *profile = request_profile(query);
+            if (!profile) {
+                response.send(Http::Code::Not_Found, "Unknown profile " + *query.get("profile"));
+                return;
+            }
+            strncpy(data.profile, profile->name.c_str(), sizeof(data.profile) - 1);
             data.client = (query.has("client"))? 1 : 0;
+            data.bidir = (query.has("bidir"))? 1 : 0;
+            string tag = query.get("tag").value_or("");
+            if (!tag.empty() && !GroupStats::valid_tag(tag)) {
+                response.send(Http::Code::Bad_Request, "Wrong tag parameter: [A-Za-z0-9._-], up to " +
+                              to_string(TAG_SZ - 1) + " characters");
+                return;
+            }
+            strncpy(data.tag, tag.c_str(), sizeof(data.tag) - 1);
             data.port = stoi(query.get("port").value_or("0"));
             if (!data.port) {
                 response.send(Http::Code::Bad_Request, "Missing port parameter");
@@ -193,47 +1118,665 @@ public:
                 response.send(Http::Code::Bad_Request, "Wrong duration parameter");
                 return;
             }
+            if (!packetization(query, &data.ptime, &data.dtx)) {
+                response.send(Http::Code::Bad_Request, "Wrong ptime parameter: 10, 20, 30... 60");
+                return;
+            }
+            string reason;
+            if (!srtp_params(query, &data, reason)) {
+                response.send(Http::Code::Bad_Request, reason);
+                return;
+            }
+            if (!impair_params(query, &data, reason)) {
+                response.send(Http::Code::Bad_Request, reason);
+                return;
+            }
+            // a source of the library, loaded before the endpoint maps it
+            string source = query.get("source").value_or("");
+            if (!source.empty()) {
+                if (!g_library.has(source)) {
+                    response.send(Http::Code::Not_Found, "Unknown source " + source);
+                    return;
+                }
+                if (!g_library.acquire(source, source_users(shared_list), reason)) {
+                    response.headers().addRaw(Http::Header::Raw("Retry-After", "1"));
+                    response.send(Http::Code::Service_Unavailable, reason);
+                    return;
+                }
+                strncpy(data.source, source.c_str(), sizeof(data.source) - 1);
+            }
+
+            long retry;
+            enqueue_rc rc = enqueue_task(shared_list, data, reason, retry);
+            if (rc == enq_conflict) {
+                response.send(Http::Code::Conflict, reason);
+                return;
+            }
+            if (rc != enq_ok) {
+                response.headers().addRaw(Http::Header::Raw("Retry-After", to_string(retry)));
+                response.send(Http::Code::Service_Unavailable, reason);
+                return;
+            }
+
+            response.send(Http::Code::Ok);
+        } catch (const exception& e) {
+            response.send(Http::Code::Internal_Server_Error, e.what());
+        }
+    }
+
+    void releaseTask(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            int port = stoi(request.query().get("port").value_or("0"));
+            if (!port) {
+                response.send(Http::Code::Bad_Request, "Missing port parameter");
+                return;
+            }
+
+            shared_list.lock();
+            Data *data = shared_list.fetch_element(port);
+            if (data && data->state != ep_released) {
+                release_endpoint(shared_list, data);
+                g_released++;
+            }
+            shared_list.unlock();
+
+            if (data)
+                response.send(Http::Code::Ok);
+            else
+                response.send(Http::Code::Not_Found, "No endpoint on port");
+        } catch (const exception& e) {
+            response.send(Http::Code::Internal_Server_Error, e.what());
+        }
+    }
+
+    void getStats(const Rest::Request&, Http::ResponseWriter response) {
+        int states[3];
+        int count = count_states(shared_list, states);
+
+        unsigned long spawns = g_spawns, reuses = g_reuses;
+        char hit_rate[16];
+        snprintf(hit_rate, sizeof(hit_rate), "%.2f%%",
+            (spawns + reuses)? reuses * 100.0 / (spawns + reuses) : 0.0);
+
+        string output =
+            "endpoints: " + to_string(count) + "\n" +
+            "active: " + to_string(states[ep_active]) + "\n" +
+            "idle: " + to_string(states[ep_idle]) + "\n" +
+            "released: " + to_string(states[ep_released]) + "\n" +
+            "spawns: " + to_string(spawns) + "\n" +
+            "reuses: " + to_string(reuses) + "\n" +
+            "reuse hit rate: " + hit_rate + "\n" +
+            "released on request: " + to_string(g_released) + "\n" +
+            "evicted on idle TTL: " + to_string(g_evicted_ttl) + "\n" +
+            "evicted as LRU: " + to_string(g_evicted_lru) + "\n";
+
+        unsigned long exits = g_exits;
+        {
+            lock_guard<mutex> lock(childrenMutex);
+            output += "children: " + to_string(g_children.size()) + "\n";
+        }
+        output +=
+            "exits: " + to_string(exits) + "\n" +
+            "exit failures: " + to_string(g_exit_failures) + "\n" +
+            "killed by signal: " + to_string(g_exit_signaled) + "\n" +
+            "left in registry: " + to_string(g_exit_cleaned) + "\n" +
+            "mean lifetime (ms): " + to_string(exits? g_lifetime_ms / exits : 0) + "\n";
+
+        if (g_endpoints_cgroup.valid()) {
+            output += cgroup_stats("endpoints", g_endpoints_cgroup.usage());
+            output += cgroup_stats("server", g_server_cgroup.usage());
+        }
+
+        output += "rejected (queue full): " + to_string(g_rejected) + "\n";
+        output += "rejected (overload): " + to_string(g_rejected_load) + "\n";
+        {
+            lock_guard<mutex> lock(queueMutex);
+            output += lane_stats("reuse", reuseQueue, reuseStats);
+            output += lane_stats("spawn", spawnQueue, spawnStats);
+        }
+        response.send(Http::Code::Ok, output);
+    }
+
+    void getLoad(const Rest::Request&, Http::ResponseWriter response) {
+        int states[3];
+        count_states(shared_list, states);
+        HostLoad load = g_host_stats.load();
+        size_t reuse_depth, spawn_depth;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            reuse_depth = reuseQueue.size();
+            spawn_depth = spawnQueue.size();
+        }
+        char cpu_idle[16], mem_headroom[16];
+        snprintf(cpu_idle, sizeof(cpu_idle), "%.1f", load.cpu_idle);
+        snprintf(mem_headroom, sizeof(mem_headroom), "%.1f",
+            (load.mem_total)? load.mem_available * 100.0 / load.mem_total : 0.0);
+        string reason = overloaded(shared_list);
+
+        string output =
+            "active streams: " + to_string(states[ep_active]) + "\n" +
+            "idle endpoints: " + to_string(states[ep_idle]) + "\n" +
+            "spawn queue depth: " + to_string(spawn_depth) + "\n" +
+            "reuse queue depth: " + to_string(reuse_depth) + "\n" +
+            "cpus: " + to_string(load.cpus) + "\n" +
+            "cpu idle (%): " + cpu_idle + "\n" +
+            "memory available (kB): " + to_string(load.mem_available) + "\n" +
+            "memory headroom (%): " + mem_headroom + "\n" +
+            "udp datagrams received: " + to_string(load.udp_in) + "\n" +
+            "udp receive errors: " + to_string(load.udp_in_errors) + "\n" +
+            "udp receive buffer errors: " + to_string(load.udp_rcvbuf_errors) + "\n" +
+            "udp send buffer errors: " + to_string(load.udp_sndbuf_errors) + "\n" +
+            "max streams: " + to_string(g_max_streams) + "\n" +
+            "admission: " + ((reason.empty())? "open" : reason) + "\n";
+        response.send(Http::Code::Ok, output);
+    }
 
+    static vector<string> split(const string& list) {
+        vector<string> items;
+        size_t start = 0, end;
+        while ((end = list.find(',', start)) != string::npos) {
+            items.push_back(list.substr(start, end - start));
+            start = end + 1;
+        }
+        if (start < list.length())
+            items.push_back(list.substr(start));
+        return items;
+    }
 
-            // Add task to worker queue
-            {
-                lock_guard<mutex> lock(queueMutex);
-                taskQueue.push(data);
+    void startPlan(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            auto query = request.query();
+            const Profile *profile = request_profile(query);
+            if (!profile) {
+                response.send(Http::Code::Not_Found, "Unknown profile " + *query.get("profile"));
+                return;
+            }
+            string tag = query.get("tag").value_or("");
+            if (!tag.empty() && !GroupStats::valid_tag(tag)) {
+                response.send(Http::Code::Bad_Request, "Wrong tag parameter: [A-Za-z0-9._-], up to " +
+                              to_string(TAG_SZ - 1) + " characters");
+                return;
+            }
+            PlanConfig config;
+            config.client = query.has("client");
+            config.bidir = query.has("bidir");
+            config.repeat = query.has("repeat");
+            config.cps = stod(query.get("cps").value_or("1"));
+            config.total_calls = stoul(query.get("total-calls").value_or("0"));
+            if (!CallPlan::parse_time(query.get("call-duration").value_or("10s"), &config.call_duration) ||
+                !CallPlan::parse_time(query.get("duration").value_or("0"), &config.duration)) {
+                response.send(Http::Code::Bad_Request, "Wrong duration parameter");
+                return;
+            }
+            if (!packetization(query, &config.ptime, &config.dtx)) {
+                response.send(Http::Code::Bad_Request, "Wrong ptime parameter: 10, 20, 30... 60");
+                return;
             }
-            queueCV.notify_one();
+            if (!CallPlan::parse_range(query.get("ports").value_or(""), &config.port_first, &config.port_last)) {
+                response.send(Http::Code::Bad_Request, "Missing or wrong ports parameter");
+                return;
+            }
+            if (!CallPlan::parse_targets(query.get("targets").value_or("127.0.0.1:5000"), config.targets)) {
+                response.send(Http::Code::Bad_Request, "Wrong targets parameter");
+                return;
+            }
+            for (const string& timepoint : split(query.get("timepoints").value_or(""))) {
+                unsigned ms;
+                if (!CallPlan::parse_time(timepoint, &ms)) {
+                    response.send(Http::Code::Bad_Request, "Wrong timepoints parameter");
+                    return;
+                }
+                config.timepoints.push_back(ms);
+            }
+            for (const string& cps : split(query.get("pattern").value_or("")))
+                config.pattern.push_back(stod(cps));
+            if (config.timepoints.size() != config.pattern.size()) {
+                response.send(Http::Code::Bad_Request, "Pattern timepoints vs cps count mismatch");
+                return;
+            }
+
+            SharedList& shared_list = this->shared_list;
+            PlanActions actions;
+            actions.port_free = [&shared_list](int port) {
+                shared_list.lock();
+                Data *data = shared_list.fetch_element(port);
+                bool free = !data || data->state == ep_idle;
+                shared_list.unlock();
+                return free;
+            };
+            string profile_name = profile->name;
+            actions.start_call = [&shared_list, profile_name, tag](const Data& call) {
+                Data data = call;
+                strncpy(data.profile, profile_name.c_str(), sizeof(data.profile) - 1);
+                strncpy(data.tag, tag.c_str(), sizeof(data.tag) - 1);
+                string reason;
+                long retry;
+                return enqueue_task(shared_list, data, reason, retry) == enq_ok;
+            };
+            actions.end_call = [&shared_list](int port) {
+                shared_list.lock();
+                Data *data = shared_list.fetch_element(port);
+                if (data && data->state != ep_released)
+                    release_endpoint(shared_list, data);
+                shared_list.unlock();
+            };
 
+            if (!g_plan.start(config, actions)) {
+                response.send(Http::Code::Conflict, "A plan is already running");
+                return;
+            }
+            LOG(log_info, "Call plan started: %.2f cps, ports %d-%d, profile %s",
+                config.cps, config.port_first, config.port_last, profile_name.c_str());
             response.send(Http::Code::Ok);
         } catch (const exception& e) {
             response.send(Http::Code::Internal_Server_Error, e.what());
         }
     }
 
-    void getStatus(const Rest::Request&, Http::ResponseWriter response) {
-        SharedList shared_list(t_client, g_shared_mem_name.c_str());
+    void getPlan(const Rest::Request&, Http::ResponseWriter response) {
+        response.send(Http::Code::Ok, g_plan.status());
+    }
+
+    void stopPlan(const Rest::Request&, Http::ResponseWriter response) {
+        g_plan.stop();
+        response.send(Http::Code::Ok, g_plan.status());
+    }
+
+    void logLevel(const Rest::Request& request, Http::ResponseWriter response) {
+        auto name = request.query().get("level");
+        if (name) {
+            log_level level;
+            if (!Logger::parse_level(name->c_str(), &level)) {
+                response.send(Http::Code::Bad_Request, "Invalid level: error, warning, info or debug");
+                return;
+            }
+            Logger::set_level(level);
+
+            // and the running endpoints; the new ones get it at spawn
+            static Data *elements[MAX_NODES];
+            shared_list.lock();
+            int count = shared_list.fetch_elements(elements, MAX_NODES);
+            for (int i = 0; i < count; i++)
+                if (elements[i]->state != ep_released)
+                    send_command(elements[i]->pid, cmd_log_level, level);
+            shared_list.unlock();
+        }
+        response.send(Http::Code::Ok,
+            string("log level: ") + Logger::level_name(Logger::level()) + "\n" +
+            "log messages dropped: " + to_string(Logger::dropped()) + "\n");
+    }
+
+    void getLibrary(const Rest::Request&, Http::ResponseWriter response) {
+        if (g_library.empty()) {
+            response.send(Http::Code::Not_Found, "No media library (-L)\n");
+            return;
+        }
+        string output =
+            "memory used (bytes): " + to_string(g_library.memory_used()) + "\n" +
+            "memory budget (bytes): " + to_string(g_library.memory_budget()) + "\n";
+        time_t now = time(NULL);
+        for (const SourceInfo& info : g_library.list(source_users(shared_list)))
+            output += info.name + " size: " + to_string(info.size) +
+                " loaded: " + ((info.loaded)? "yes" : "no") +
+                " users: " + to_string(info.users) +
+                " last used (s ago): " + ((info.last_used)? to_string(now - info.last_used) : "-") +
+                "\n";
+        response.send(Http::Code::Ok, output);
+    }
+
+    void getProfiles(const Rest::Request&, Http::ResponseWriter response) {
+        static Data *elements[MAX_NODES];
+        map<string, int> endpoints, active;
         shared_list.lock();
-        string output = shared_list.print_list();
+        int count = shared_list.fetch_elements(elements, MAX_NODES);
+        for (int i = 0; i < count; i++) {
+            endpoints[elements[i]->profile]++;
+            if (elements[i]->state == ep_active)
+                active[elements[i]->profile]++;
+        }
         shared_list.unlock();
+
+        const char *env_bucket = getenv("bucket");
+        string output;
+        for (const Profile& p : g_profiles)
+            output += p.name + " port: " + ((p.port)? to_string(p.port) : "-") +
+                " codec: " + ((p.codec.empty())? "-" : p.codec) +
+                " wavefile: " + p.wavefile +
+                " bucket: " + ((!p.influx_bucket.empty())? p.influx_bucket :
+                               (env_bucket)? env_bucket : "-") +
+                " endpoints: " + to_string(endpoints[p.name]) +
+                " active: " + to_string(active[p.name]) + "\n";
         response.send(Http::Code::Ok, output);
     }
 
+    static string json_distribution(const char *name, const Distribution& d) {
+        char out[160];
+        snprintf(out, sizeof(out),
+            "\"%s\":{\"mean\":%.2f,\"min\":%.2f,\"max\":%.2f,\"p5\":%.2f,\"p50\":%.2f,\"p95\":%.2f}",
+            name, d.mean, d.min, d.max, d.p5, d.p50, d.p95);
+        return out;
+    }
+
+    static string json_direction(const char *name, const DirSummary& dir) {
+        return string("\"") + name + "\":{\"reports\":" + to_string(dir.reports) + "," +
+            json_distribution("mos", dir.mos) + "," +
+            json_distribution("loss_pct", dir.loss_pct) + "," +
+            json_distribution("jitter_ms", dir.jitter_ms) + "}";
+    }
+
+    static string direction_stats(const string& tag, const char *name, const DirSummary& dir) {
+        if (!dir.reports)
+            return "";
+        char out[320];
+        snprintf(out, sizeof(out),
+            "%s %s reports: %lu mos mean: %.2f min: %.2f p5: %.2f p50: %.2f "
+            "loss (%%) mean: %.2f p50: %.2f p95: %.2f max: %.2f "
+            "jitter (ms) mean: %.2f p50: %.2f p95: %.2f max: %.2f\n",
+            tag.c_str(), name, dir.reports, dir.mos.mean, dir.mos.min, dir.mos.p5, dir.mos.p50,
+            dir.loss_pct.mean, dir.loss_pct.p50, dir.loss_pct.p95, dir.loss_pct.max,
+            dir.jitter_ms.mean, dir.jitter_ms.p50, dir.jitter_ms.p95, dir.jitter_ms.max);
+        return out;
+    }
+
+    void getGroups(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            auto query = request.query();
+            bool json = query.get("format").value_or("") == "json";
+            unsigned window = GroupStats::window_of(
+                stoul(query.get("window").value_or(to_string(GROUP_SLICES * GROUP_SLICE))));
+
+            // the active streams, per tag
+            static Data *elements[MAX_NODES];
+            map<string, unsigned> streams;
+            shared_list.lock();
+            int count = shared_list.fetch_elements(elements, MAX_NODES);
+            for (int i = 0; i < count; i++)
+                if (elements[i]->tag[0] && elements[i]->state == ep_active)
+                    streams[elements[i]->tag]++;
+            shared_list.unlock();
+
+            string output;
+            vector<GroupSummary> groups = g_groups.summary(time(NULL), window, streams);
+            if (json) {
+                output = "{\"window\":" + to_string(window) +
+                    ",\"reports_dropped\":" + to_string(g_groups.reports_dropped()) + ",\"groups\":[";
+                for (size_t i = 0; i < groups.size(); i++)
+                    output += string((i)? "," : "") + "{\"tag\":\"" + groups[i].tag + "\"," +
+                        "\"streams\":" + to_string(groups[i].streams) + "," +
+                        json_direction("tx", groups[i].tx) + "," + json_direction("rx", groups[i].rx) + "}";
+                output += "]}\n";
+            } else {
+                output = "window (s): " + to_string(window) + "\n" +
+                    "reports dropped: " + to_string(g_groups.reports_dropped()) + "\n";
+                for (const GroupSummary& group : groups)
+                    output += group.tag + " streams: " + to_string(group.streams) + "\n" +
+                        direction_stats(group.tag, "tx", group.tx) +
+                        direction_stats(group.tag, "rx", group.rx);
+            }
+            response.send(Http::Code::Ok, output);
+        } catch (const exception& e) {
+            response.send(Http::Code::Internal_Server_Error, e.what());
+        }
+    }
+
+    void getThreads(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            auto query = request.query();
+            bool json = query.get("format").value_or("") == "json";
+            int port = stoi(query.get("port").value_or("0"));
+
+            // the server's own, or an endpoint's, by its port
+            pid_t pid = 0;
+            if (port) {
+                shared_list.lock();
+                Data *data = shared_list.fetch_element(port);
+                if (data && data->state != ep_released)
+                    pid = data->pid;
+                shared_list.unlock();
+                if (pid <= 0) {
+                    response.send(Http::Code::Not_Found, "No endpoint on port");
+                    return;
+                }
+            }
+
+            vector<ThreadStat> threads = thread_stats(pid);
+            if (threads.empty()) {
+                response.send(Http::Code::Not_Found, "No such process");
+                return;
+            }
+            response.send(Http::Code::Ok,
+                (json)? thread_report_json(pid, threads) : thread_report(threads));
+        } catch (const exception& e) {
+            response.send(Http::Code::Internal_Server_Error, e.what());
+        }
+    }
+
+    static string cgroup_stats(const string& name, const CgroupUsage& usage) {
+        return
+            name + " cpu usage (us): " + to_string(usage.cpu_usec) + "\n" +
+            name + " cpu user (us): " + to_string(usage.user_usec) + "\n" +
+            name + " cpu system (us): " + to_string(usage.system_usec) + "\n" +
+            name + " cpu throttled (us): " + to_string(usage.throttled_usec) + "\n" +
+            name + " memory (bytes): " + to_string(usage.memory) + "\n";
+    }
+
+    static string lane_stats(const string& name, const queue<Task>& lane, const LaneStats& stats) {
+        using chrono::duration_cast;
+        using chrono::microseconds;
+        return
+            name + " queue depth: " + to_string(lane.size()) + "\n" +
+            name + " queue max depth: " + to_string(stats.max_depth) + "\n" +
+            name + " tasks: " + to_string(stats.tasks) + "\n" +
+            name + " mean wait (us): " + to_string(stats.tasks?
+                duration_cast<microseconds>(stats.wait_sum).count() / stats.tasks : 0) + "\n" +
+            name + " max wait (us): " + to_string(
+                duration_cast<microseconds>(stats.wait_max).count()) + "\n";
+    }
+
+    void getStatus(const Rest::Request& request, Http::ResponseWriter response) {
+        try {
+            auto query = request.query();
+            bool json = query.get("format").value_or("") == "json";
+
+            // changes since seq N, possibly waiting for them
+            auto since = query.get("since");
+            if (since) {
+                unsigned long long seq = stoull(*since);
+                int wait = min(stoi(query.get("wait").value_or("0")), STATUS_MAX_WAIT);
+                if (wait > 0 && shared_list.journal_seq() == seq) {
+                    lock_guard<mutex> lock(waitersMutex);
+                    g_status_waiters.push_back(StatusWaiter{seq, json,
+                        Clock::now() + chrono::seconds(wait), move(response)});
+                    return;
+                }
+                send_changes(shared_list, seq, json, response);
+                return;
+            }
+
+            // a snapshot; copied under the lock, filtered and formatted out of it
+            vector<Data> elements(MAX_NODES);
+            int count;
+            shared_list.lock();
+            unsigned long long seq = shared_list.snapshot(elements.data(), MAX_NODES, &count);
+            shared_list.unlock();
+
+            string state = query.get("state").value_or("");
+            string profile_name = query.get("profile").value_or("");
+            string tag = query.get("tag").value_or("");
+            size_t offset = stoul(query.get("offset").value_or("0"));
+            size_t limit = stoul(query.get("limit").value_or("0"));
+            vector<const Data*> selected;
+            for (int i = 0; i < count; i++)
+                if ((state.empty() || state == state_name(elements[i].state)) &&
+                    (profile_name.empty() || profile_name == elements[i].profile) &&
+                    (tag.empty() || tag == elements[i].tag))
+                    selected.push_back(&elements[i]);
+            size_t first = min(offset, selected.size());
+            size_t last = (limit)? min(first + limit, selected.size()) : selected.size();
+
+            string output;
+            CgroupUsage usage = {};
+            if (g_endpoints_cgroup.valid())
+                usage = g_endpoints_cgroup.usage();
+            if (json) {
+                output = "{\"seq\":" + to_string(seq) + ",\"total\":" + to_string(selected.size()) +
+                    ",\"offset\":" + to_string(first);
+                if (g_endpoints_cgroup.valid())
+                    output += ",\"endpoints_cpu_usec\":" + to_string(usage.cpu_usec) +
+                        ",\"endpoints_mem\":" + to_string(usage.memory);
+                output += ",\"endpoints\":[";
+                for (size_t i = first; i < last; i++)
+                    output += string((i > first)? "," : "") + json_element(*selected[i]);
+                output += "]}\n";
+            } else {
+                if (g_endpoints_cgroup.valid())
+                    output = "endpoints cpu time (us): " + to_string(usage.cpu_usec) +
+                        " mem: " + to_string(usage.memory) + "\n";
+                for (size_t i = first; i < last; i++)
+                    output += SharedList::print_element(const_cast<Data*>(selected[i])) + string("\n");
+            }
+            response.headers().addRaw(Http::Header::Raw("X-Registry-Seq", to_string(seq)));
+            response.send(Http::Code::Ok, output);
+        } catch (const exception& e) {
+            response.send(Http::Code::Internal_Server_Error, e.what());
+        }
+    }
+
 };
 
 void cleanup(int sig)
 {
     b_running = false;
     queueCV.notify_one();
+    idleCV.notify_one();
 
 }
 
+// a profile, NAME[:PORT][,KEY=VALUE]..., over the default one's settings
+static bool parse_profile(const string& spec, Profile& profile, string& error) {
+    vector<string> items = RestAPIHandler::split(spec);
+    profile = g_profiles[0];
+    profile.port = 0;
+    profile.name = (items.empty())? "" : items[0];
+    size_t colon = profile.name.find(':');
+    if (colon != string::npos) {
+        profile.port = atoi(profile.name.c_str() + colon + 1);
+        profile.name.erase(colon);
+        if (!profile.port) {
+            error = "invalid port";
+            return false;
+        }
+    }
+    if (profile.name.empty() || profile.name.size() >= PROFILE_SZ ||
+        profile.name.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"
+                                       "0123456789-_") != string::npos) {
+        error = "name not of [A-Za-z0-9_-], up to " + to_string(PROFILE_SZ - 1) + " characters";
+        return false;
+    }
+    for (size_t i = 1; i < items.size(); i++) {
+        size_t eq = items[i].find('=');
+        string key = items[i].substr(0, eq);
+        string value = (eq != string::npos)? items[i].substr(eq + 1) : "";
+        if (key == "codec")
+            profile.codec = value;
+        else if (key == "wave")
+            profile.wavefile = value;
+        else if (key == "url")
+            profile.influx_url = value;
+        else if (key == "org")
+            profile.influx_org = value;
+        else if (key == "bucket")
+            profile.influx_bucket = value;
+        else if (key == "token")
+            profile.influx_token = value;
+        else {
+            error = "unknown setting " + key + ": codec, wave, url, org, bucket or token";
+            return false;
+        }
+    }
+    for (const Profile& other : g_profiles) {
+        if (other.name == profile.name) {
+            error = "name already in use";
+            return false;
+        }
+        if (profile.port && other.port == profile.port) {
+            error = "port already in use";
+            return false;
+        }
+    }
+    return true;
+}
+
 static const char desc[] =
 "                                                                   \n"
-"%s [-p PORT] [-w WAFEFILE] [-h]                                    \n"
+"%s [-p PORT] [-w WAFEFILE] [-y PCAP[,FLOW[,SPEED]]] [-c CODEC]     \n"
+"        [-i MAX] [-t TTL]                                          \n"
+"        [-q MAX] [-s RATE] [-S MAX] [-U IDLE] [-a CPUS [-N]] [-r PRIO]  \n"
+"        [-g [-G] [-C CPUS] [-M MB]] [-R] [-l LEVEL] [-P PTIME [-D]] \n"
+"        [-K] [-O] [-x MODE] [-F] [-X KEY] [-L DIR [-B MB]]         \n"
+"        [-V NAME[:PORT][,KEY=VALUE]...]... [-h]                    \n"
 "                                                                   \n"
 "where:                                                             \n"
 "                                                                   \n"
 "-p PORT             The server's listening port (default: %d)      \n"
 "-w WAFEFILE         The wavefile clients will send                 \n"
+"-y PCAP[,FLOW[,SPEED]]                                             \n"
+"                    Clients replay an RTP flow of a pcap/pcapng    \n"
+"                    capture instead: the SSRC (0x...) or UDP port  \n"
+"                    of the flow (default: the first one), and the  \n"
+"                    timing scale (default: 1, the capture's)       \n"
 "-c CODEC            ITU G.711 'pcma' or 'pcmu' (default: pcmu)     \n"
+"-i MAX              Max idle endpoints, kept for reuse; the least  \n"
+"                    recently used ones are released (default: no max)\n"
+"-t TTL              Idle endpoints' lifetime, in sec (default: none)\n"
+"-q MAX              Max queued requests; above it, /stream answers \n"
+"                    503 with Retry-After (default: 1000)           \n"
+"-s RATE             Max spawns of new endpoints per sec; reuses are\n"
+"                    not limited (default: no max)                  \n"
+"-S MAX              Admission: max active streams (default: no max)\n"
+"-U IDLE             Admission: min CPU idle, in %% (default: none)  \n"
+"-a CPUS             Pin the endpoints, round-robin, on a CPU list, \n"
+"                    e.g. 2-7,10 (default: no pinning)              \n"
+"-N                  Spread the pinned endpoints across NUMA nodes  \n"
+"-r PRIO             SCHED_FIFO priority of the endpoints' sender   \n"
+"                    threads (default: normal scheduling)           \n"
+"-g                  Account the endpoints in a cgroup v2 subtree   \n"
+"-G                  ... and in a cgroup per endpoint               \n"
+"-C CPUS             Endpoints' CPU limit, in CPUs, e.g. 2.5 (-g)   \n"
+"-M MB               Endpoints' memory limit, in MB (-g)            \n"
+"-R                  Warm restart: adopt the running endpoints of a \n"
+"                    previous server, and keep them on exit         \n"
+"-l LEVEL            Log level: error, warning, info or debug; also \n"
+"                    set at runtime with /log (default: info)       \n"
+"-P PTIME            Endpoints' packet time, in ms: 10, 20, 30... 60;\n"
+"                    /stream's ptime= (default: the codec's, 20)    \n"
+"-D                  Endpoints' DTX: silence not sent; /stream's dtx=\n"
+"                    (default: off)                                 \n"
+"-K                  Endpoints' kernel timestamps: jitter measured  \n"
+"                    on them, and the host's delay reported apart   \n"
+"-O                  Endpoints' one-way delay, between Media Servers\n"
+"                    (clocks synced): send time in an RTP header    \n"
+"                    extension (default: off)                       \n"
+"-x MODE             Endpoints' RTCP-XR VoIP metrics: 'both' sides  \n"
+"                    report, or only the 'sender', with the         \n"
+"                    receiver's figures (default: off)              \n"
+"-F                  Endpoints' fast start: InfluxDB client deferred\n"
+"                    to the first report, only the codec in use,    \n"
+"                    pools pre-sized (default: off)                 \n"
+"-X KEY              Preshared SRTP master key and salt (base64), of\n"
+"                    the /stream requests with srtp= but no srtp_key\n"
+"-L DIR              Media library: the audio sources (*.wav, PCM   \n"
+"                    16-bit mono 8000Hz) of /stream's source=NAME,  \n"
+"                    loaded once in shared memory for all endpoints \n"
+"-B MB               Media library's memory budget: the least       \n"
+"                    recently used sources unloaded (default: none) \n"
+"-V NAME[:PORT][,KEY=VALUE]...                                      \n"
+"                    A profile of the endpoints, with its own port, \n"
+"                    or selected by /stream's profile=NAME; KEY:    \n"
+"                    codec, wave (the wavefile), and the InfluxDB's \n"
+"                    url, org, bucket and token (default: those of  \n"
+"                    the server's). Repeated for several profiles,  \n"
+"                    all on one registry, worker and media library  \n"
 "--help -h           This help                                      \n"
 "                                                                   \n"
 ;
@@ -242,8 +1785,16 @@ static const char desc[] =
 int main(int argc, char* argv[])
 {
 
+    string cpu_list;
+    bool numa_spread = false;
+    bool cgroups = false;
+    double cpu_limit = 0;
+    unsigned long long memory_limit = 0;
+    string library_dir;
+    size_t library_budget = 0;
+    vector<string> profile_specs;
     int opt;
-    while ((opt = getopt(argc, argv, "hp:w:c:")) != -1) {
+    while ((opt = getopt(argc, argv, "hp:w:y:c:i:t:q:s:S:U:a:Nr:gGC:M:Rl:P:DKOx:FX:L:B:V:")) != -1) {
         switch (opt) {
             case 'p':
                 g_port = atoi(optarg);
@@ -251,9 +1802,113 @@ int main(int argc, char* argv[])
             case 'w':
                 g_wavefile = optarg;
                 break;
+            case 'y': {
+                vector<string> replay = RestAPIHandler::split(optarg);
+                if (replay.empty() || replay.size() > 3) {
+                    cout << "Invalid replay " << optarg << endl;
+                    return 1;
+                }
+                g_replay = replay[0];
+                g_replay_flow = (replay.size() > 1)? replay[1] : "";
+                g_replay_speed = (replay.size() > 2)? replay[2] : "";
+                break;
+            }
             case 'c':
                 g_codec = optarg;
                 break;
+            case 'i':
+                g_max_idle = atoi(optarg);
+                break;
+            case 't':
+                g_idle_ttl = atoi(optarg);
+                break;
+            case 'q':
+                g_queue_max = atoi(optarg);
+                break;
+            case 's':
+                g_spawn_rate = atof(optarg);
+                break;
+            case 'S':
+                g_max_streams = atoi(optarg);
+                break;
+            case 'U':
+                g_min_cpu_idle = atof(optarg);
+                break;
+            case 'a':
+                cpu_list = optarg;
+                break;
+            case 'N':
+                numa_spread = true;
+                break;
+            case 'r':
+                g_rt_prio = atoi(optarg);
+                break;
+            case 'G':
+                g_endpoint_cgroups = true;
+                // fall through
+            case 'g':
+                cgroups = true;
+                break;
+            case 'C':
+                cpu_limit = atof(optarg);
+                break;
+            case 'M':
+                memory_limit = strtoull(optarg, NULL, 10) << 20;
+                break;
+            case 'R':
+                g_warm_restart = true;
+                break;
+            case 'l': {
+                log_level level;
+                if (!Logger::parse_level(optarg, &level)) {
+                    cout << "Invalid log level " << optarg << endl;
+                    return 1;
+                }
+                Logger::set_level(level);
+                break;
+            }
+            case 'P':
+                g_ptime = atoi(optarg);
+                if (!valid_ptime(g_ptime)) {
+                    cout << "Invalid ptime " << optarg << endl;
+                    return 1;
+                }
+                break;
+            case 'D':
+                g_dtx = true;
+                break;
+            case 'K':
+                g_kernel_ts = true;
+                break;
+            case 'O':
+                g_owd = true;
+                break;
+            case 'x':
+                g_rtcp_xr = optarg;
+                if (g_rtcp_xr != "both" && g_rtcp_xr != "sender") {
+                    cout << "Invalid RTCP-XR mode " << optarg << ": both or sender" << endl;
+                    return 1;
+                }
+                break;
+            case 'F':
+                g_fast_start = true;
+                break;
+            case 'X':
+                g_srtp_key = optarg;
+                if (base64_size(g_srtp_key) <= 0 || g_srtp_key.size() >= SRTP_KEY_SZ) {
+                    cout << "Invalid SRTP key: base64 expected" << endl;
+                    return 1;
+                }
+                break;
+            case 'L':
+                library_dir = optarg;
+                break;
+            case 'B':
+                library_budget = strtoull(optarg, NULL, 10) << 20;
+                break;
+            case 'V':
+                profile_specs.push_back(optarg);
+                break;
             case 'h':
             default:
                 printf(desc, basename(argv[0]), PORT);
@@ -262,49 +1917,125 @@ int main(int argc, char* argv[])
         }
     }
 
-    value.sival_int = 0;  // dummy payload
 
+    g_profiles.push_back(Profile{DEFAULT_PROFILE, g_port, g_codec, g_wavefile, "", "", "", ""});
+    for (const string& spec : profile_specs) {
+        Profile profile;
+        string error;
+        if (!parse_profile(spec, profile, error)) {
+            cout << "Invalid profile " << spec << ": " << error << endl;
+            return 1;
+        }
+        g_profiles.push_back(profile);
+    }
+
+    if (!cpu_list.empty() && !g_placement.configure(cpu_list, numa_spread)) {
+        cout << "Invalid CPU list " << cpu_list << endl;
+        return 1;
+    }
 
-    // Register termination signal
-    signal(SIGINT, cleanup);
+    if (cgroups && !setup_cgroups(cpu_limit, memory_limit)) {
+        Logger::stop();
+        return 1;
+    }
 
-    // Set up SIGCHLD handler
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    sigaction(SIGCHLD, &sa, NULL);
+    // Termination and SIGCHLD signals are handled through a signalfd, by
+    // the main thread; block them before any thread starts
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    int sfd = signalfd(-1, &signals, SFD_CLOEXEC);
+    if (sfd == -1) {
+        perror("signalfd failed");
+        return 1;
+    }
+    Logger::start();
 
     // Initialize the in-shared-memory list
     g_shared_mem_name = SHM_NAME + string("_") + to_string(g_port);
     SharedList shared_list = SharedList(t_server, g_shared_mem_name.c_str());
-    shared_list.initialize();
+    if (g_warm_restart) {
+        // keep it for the next server, and take over the previous one's
+        shared_list.persist();
+        int adopted = shared_list.adopt(endpoint_alive);
+        if (adopted < 0) {
+            LOG(log_warning, "No valid registry to adopt");
+            shared_list.initialize();
+        } else
+            LOG(log_info, "Adopted %d endpoints", adopted);
+    } else
+        shared_list.initialize();
+
+    // its sources in shared memory, named after the registry's
+    if (!library_dir.empty()) {
+        string error;
+        if (!g_library.open(library_dir, g_shared_mem_name, library_budget, error)) {
+            LOG(log_error, "Media library: %s", error.c_str());
+            Logger::stop();
+            return 1;
+        }
+    }
 
     // Start worker thread
     thread worker(workerThread, ref(shared_list));
+    thread housekeeper(housekeepingThread, ref(shared_list));
+    thread status_waiter(statusWaitThread, ref(shared_list));
 
-    // Set up REST API server
-    Pistache::Address addr(Pistache::Ipv4::any(), Pistache::Port(g_port));
-    auto opts = Pistache::Http::Endpoint::options().threads(2);
-
-    RestAPIHandler handler;
-    Rest::Router router;
-    handler.setupRoutes(router);
+    // Set up a REST API server per profile with a port; the others are
+    // selected with profile=, on any port
+    vector<unique_ptr<RestAPIHandler>> handlers;
+    vector<unique_ptr<Rest::Router>> routers;
+    vector<unique_ptr<Http::Endpoint>> servers;
+    // started from a thread of their own, whose name Pistache's threads
+    // inherit; the main thread keeps the process's
+    thread http_starter([&] {
+        set_thread_name("ms-http");
+        for (const Profile& profile : g_profiles) {
+            if (!profile.port)
+                continue;
+            Pistache::Address addr(Pistache::Ipv4::any(), Pistache::Port(profile.port));
+            // the default profile's takes the most requests, in general
+            auto opts = Pistache::Http::Endpoint::options().threads((servers.empty())? 2 : 1);
 
-    Http::Endpoint server(addr);
-    server.init(opts);
-    server.setHandler(router.handler());
+            handlers.emplace_back(new RestAPIHandler(shared_list, profile));
+            routers.emplace_back(new Rest::Router);
+            handlers.back()->setupRoutes(*routers.back());
 
+            servers.emplace_back(new Http::Endpoint(addr));
+            servers.back()->init(opts);
+            servers.back()->setHandler(routers.back()->handler());
 
-    cout << "Server starting on port " << g_port << endl;
-    server.serveThreaded();
+            LOG(log_info, "Server starting on port %d, profile %s", profile.port, profile.name.c_str());
+            servers.back()->serveThreaded();
+        }
+    });
+    http_starter.join();
 
+    // Supervise the children, until terminated
     while(b_running) {
-        pause();
+        signalfd_siginfo si;
+        if (read(sfd, &si, sizeof(si)) != sizeof(si)) {
+            if (errno == EINTR) continue;
+            LOG(log_error, "signalfd read failed: %s", strerror(errno));
+            cleanup(0);
+            break;
+        }
+        if (si.ssi_signo == SIGCHLD)
+            reap_children(shared_list);
+        else
+            cleanup(si.ssi_signo);
     }
+    close(sfd);
 
+    g_plan.stop();
     worker.join();
+    housekeeper.join();
+    status_waiter.join();
 
-    cout << "Server shutdown complete" << endl;
+    LOG(log_info, "Server shutdown complete");
+    Logger::stop();
     return 0;
 }
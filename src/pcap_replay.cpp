@@ -0,0 +1,346 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "pcap_replay.h"
+
+#define PCAP_MAGIC_US       0xa1b2c3d4
+#define PCAP_MAGIC_NS       0xa1b23c4d
+#define PCAPNG_SHB          0x0A0D0D0A
+#define PCAPNG_IDB          0x00000001
+#define PCAPNG_EPB          0x00000006
+#define PCAPNG_BOM          0x1A2B3C4D
+#define PCAPNG_TSRESOL      9
+
+#define LINKTYPE_ETHERNET   1
+#define LINKTYPE_RAW        101
+#define LINKTYPE_LINUX_SLL  113
+#define LINKTYPE_LINUX_SLL2 276
+
+#define ETH_IPV4            0x0800
+#define ETH_IPV6            0x86DD
+#define ETH_VLAN            0x8100
+#define ETH_QINQ            0x88A8
+#define IP_UDP              17
+
+static inline uint16_t be16(const uint8_t *p)
+{
+    return p[0] << 8 | p[1];
+}
+
+static inline uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// the file's own byte order
+static inline uint32_t rd32(const uint8_t *p, bool swapped)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (swapped)? __builtin_bswap32(v) : v;
+}
+
+static inline uint16_t rd16(const uint8_t *p, bool swapped)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return (swapped)? __builtin_bswap16(v) : v;
+}
+
+PcapReplay::~PcapReplay()
+{
+    if (map)
+        munmap((void *)map, map_size);
+}
+
+bool PcapReplay::open(const char *path, const std::string& flow, std::string& error)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1) {
+        error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < 24) {
+        ::close(fd);
+        error = std::string(path) + ": not a capture";
+        return false;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+    map = (const uint8_t *)addr;
+    map_size = st.st_size;
+
+    // read once through, to index
+    madvise(addr, map_size, MADV_SEQUENTIAL);
+    if (!index(flow, error))
+        return false;
+    error.clear();
+    return true;
+}
+
+bool PcapReplay::index(const std::string& flow, std::string& error)
+{
+    uint16_t want_port = 0;
+    uint32_t want_ssrc = 0;
+    bool by_ssrc = false;
+    if (!flow.empty()) {
+        char *end;
+        unsigned long value = strtoul(flow.c_str(), &end, 0);
+        by_ssrc = (flow.compare(0, 2, "0x") == 0 || flow.compare(0, 2, "0X") == 0);
+        if (*end || (!by_ssrc && (value == 0 || value > 65535)) || value > 0xffffffffUL) {
+            error = "invalid flow " + flow + ": an SSRC (0x...) or a UDP port";
+            return false;
+        }
+        if (by_ssrc)
+            want_ssrc = value;
+        else
+            want_port = value;
+    }
+
+    uint32_t magic;
+    memcpy(&magic, map, sizeof(magic));
+    bool ok;
+    if (magic == PCAPNG_SHB)
+        ok = index_pcapng(want_port, want_ssrc, by_ssrc, error);
+    else
+        ok = index_pcap(want_port, want_ssrc, by_ssrc, error);
+    if (!ok)
+        return false;
+
+    if (packets.empty()) {
+        error = (flow.empty())? std::string("no RTP flow in the capture") :
+                                "no RTP flow " + flow + " in the capture";
+        return false;
+    }
+
+    // times from the first packet; never backwards
+    uint64_t start = packets[0].time_ns, last = 0;
+    for (ReplayPacket& pkt : packets) {
+        pkt.time_ns = (pkt.time_ns > start)? pkt.time_ns - start : 0;
+        if (pkt.time_ns < last)
+            pkt.time_ns = last;
+        last = pkt.time_ns;
+    }
+    size_t n = packets.size();
+    step_ns = (n > 1)? packets[n - 1].time_ns - packets[n - 2].time_ns : 20000000;
+    step_ts = (n > 1)? packets[n - 1].ts - packets[n - 2].ts : 160;
+    packets.shrink_to_fit();
+    return true;
+}
+
+bool PcapReplay::index_pcap(uint16_t want_port, uint32_t want_ssrc, bool by_ssrc,
+                            std::string& error)
+{
+    uint32_t magic;
+    memcpy(&magic, map, sizeof(magic));
+    bool swapped = (magic == __builtin_bswap32(PCAP_MAGIC_US) ||
+                    magic == __builtin_bswap32(PCAP_MAGIC_NS));
+    if (swapped)
+        magic = __builtin_bswap32(magic);
+    if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+        error = "not a pcap or pcapng capture";
+        return false;
+    }
+    uint64_t frac_ns = (magic == PCAP_MAGIC_NS)? 1 : 1000;
+    int linktype = rd32(map + 20, swapped) & 0xffff;
+
+    size_t pos = 24;
+    while (pos + 16 <= map_size) {
+        uint64_t sec = rd32(map + pos, swapped);
+        uint64_t frac = rd32(map + pos + 4, swapped);
+        size_t caplen = rd32(map + pos + 8, swapped);
+        pos += 16;
+        if (caplen > map_size - pos)
+            break;                      // truncated
+        add_frame(linktype, pos, caplen, sec * 1000000000 + frac * frac_ns,
+                  want_port, want_ssrc, by_ssrc);
+        pos += caplen;
+    }
+    return true;
+}
+
+bool PcapReplay::index_pcapng(uint16_t want_port, uint32_t want_ssrc, bool by_ssrc,
+                              std::string& error)
+{
+    // per interface of the current section
+    struct Interface {
+        int linktype;
+        bool pow2;                      // resolution: 2^-exp, otherwise 10^-exp
+        unsigned exp;
+    };
+    std::vector<Interface> interfaces;
+    bool swapped = false;
+
+    size_t pos = 0;
+    while (pos + 12 <= map_size) {
+        uint32_t type = rd32(map + pos, swapped);
+        if (type == PCAPNG_SHB) {
+            swapped = (rd32(map + pos + 8, false) != PCAPNG_BOM);
+            if (swapped && rd32(map + pos + 8, true) != PCAPNG_BOM) {
+                error = "corrupted pcapng section";
+                return false;
+            }
+            interfaces.clear();
+        }
+        size_t len = rd32(map + pos + 4, swapped);
+        if (len < 12 || len % 4 || len > map_size - pos)
+            break;                      // truncated
+
+        const uint8_t *block = map + pos;
+        if (type == PCAPNG_IDB && len >= 20) {
+            Interface itf = {rd16(block + 8, swapped), false, 6};
+            // options: code, length, value padded to 32 bits
+            for (size_t opt = 16; opt + 4 <= len - 4; ) {
+                uint16_t code = rd16(block + opt, swapped);
+                uint16_t opt_len = rd16(block + opt + 2, swapped);
+                if (code == 0 || opt + 4 + opt_len > len - 4)
+                    break;
+                if (code == PCAPNG_TSRESOL && opt_len == 1 && (block[opt + 4] & 0x7f) < 64) {
+                    itf.pow2 = block[opt + 4] & 0x80;
+                    itf.exp = block[opt + 4] & 0x7f;
+                }
+                opt += 4 + ((opt_len + 3) & ~3);
+            }
+            interfaces.push_back(itf);
+        } else if (type == PCAPNG_EPB && len >= 32) {
+            uint32_t id = rd32(block + 8, swapped);
+            uint64_t ts = (uint64_t)rd32(block + 12, swapped) << 32 | rd32(block + 16, swapped);
+            size_t caplen = rd32(block + 20, swapped);
+            if (id < interfaces.size() && caplen <= len - 32) {
+                const Interface& itf = interfaces[id];
+                uint64_t ns;
+                if (itf.pow2)
+                    ns = (ts >> itf.exp) * 1000000000 +
+                         (((ts & ((1ULL << itf.exp) - 1)) * 1000000000) >> itf.exp);
+                else {
+                    ns = ts;
+                    for (unsigned e = itf.exp; e < 9; e++)
+                        ns *= 10;
+                    for (unsigned e = 9; e < itf.exp; e++)
+                        ns /= 10;
+                }
+                add_frame(itf.linktype, pos + 28, caplen, ns, want_port, want_ssrc, by_ssrc);
+            }
+        }
+        pos += len;
+    }
+    return true;
+}
+
+// index the frame if it is a packet of the flow; the flow is the first one
+// that matches, identified then by its SSRC and destination port
+void PcapReplay::add_frame(int linktype, size_t offset, size_t caplen, uint64_t time_ns,
+                           uint16_t want_port, uint32_t want_ssrc, bool by_ssrc)
+{
+    const uint8_t *p = map + offset;
+    size_t n = caplen;
+    uint16_t ethertype;
+
+    switch (linktype) {
+    case LINKTYPE_ETHERNET:
+        if (n < 14)
+            return;
+        ethertype = be16(p + 12);
+        p += 14;
+        n -= 14;
+        while (ethertype == ETH_VLAN || ethertype == ETH_QINQ) {
+            if (n < 4)
+                return;
+            ethertype = be16(p + 2);
+            p += 4;
+            n -= 4;
+        }
+        break;
+    case LINKTYPE_LINUX_SLL:
+        if (n < 16)
+            return;
+        ethertype = be16(p + 14);
+        p += 16;
+        n -= 16;
+        break;
+    case LINKTYPE_LINUX_SLL2:
+        if (n < 20)
+            return;
+        ethertype = be16(p);
+        p += 20;
+        n -= 20;
+        break;
+    case LINKTYPE_RAW:
+        if (n < 1)
+            return;
+        ethertype = (p[0] >> 4 == 4)? ETH_IPV4 : (p[0] >> 4 == 6)? ETH_IPV6 : 0;
+        break;
+    default:
+        return;
+    }
+
+    if (ethertype == ETH_IPV4) {
+        if (n < 20 || p[9] != IP_UDP || (be16(p + 6) & 0x3fff))    // fragments
+            return;
+        size_t ihl = (p[0] & 0xf) * 4;
+        if (ihl < 20 || n < ihl)
+            return;
+        p += ihl;
+        n -= ihl;
+    } else if (ethertype == ETH_IPV6) {
+        if (n < 40 || p[6] != IP_UDP)
+            return;
+        p += 40;
+        n -= 40;
+    } else
+        return;
+
+    // UDP
+    if (n < 8)
+        return;
+    uint16_t dport = be16(p + 2);
+    size_t udp_len = be16(p + 4);
+    p += 8;
+    n -= 8;
+    if (udp_len >= 8) {
+        if (udp_len - 8 > n)
+            return;                 // truncated by the snaplen
+        n = udp_len - 8;            // without the link layer's padding
+    }
+
+    // RTP v2, not RTCP (its types, as payload types with the marker)
+    if (n < 12 || n > UINT16_MAX || (p[0] >> 6) != 2 ||
+        ((p[1] & 0x7f) >= 72 && (p[1] & 0x7f) <= 76))
+        return;
+    uint32_t pkt_ssrc = be32(p + 8);
+
+    if (packets.empty()) {
+        if ((by_ssrc && pkt_ssrc != want_ssrc) || (want_port && dport != want_port))
+            return;
+        ssrc = pkt_ssrc;
+        flow_port = dport;
+    } else if (pkt_ssrc != ssrc || dport != flow_port)
+        return;
+
+    ReplayPacket pkt;
+    pkt.offset = p - map;
+    pkt.len = n;
+    pkt.seq = be16(p + 2);
+    pkt.ts = be32(p + 4);
+    pkt.time_ns = time_ns;
+    packets.push_back(pkt);
+}
+
+uint64_t PcapReplay::loop_ns() const
+{
+    return duration_ns() + step_ns;
+}
+
+uint32_t PcapReplay::loop_ts() const
+{
+    return (packets.empty())? 0 : packets.back().ts - packets.front().ts + step_ts;
+}
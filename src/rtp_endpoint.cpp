@@ -1,5 +1,12 @@
 #include "rtp_endpoint.h"
+#include "g711_codec.h"
+#include "pcap_replay.h"
+#include "logger.h"
+#include "thread_stats.h"
 #include <chrono>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
 
 #define STRINGIFY(x) #x
 #define TOSTRING(x) STRINGIFY(x)
@@ -8,18 +15,69 @@
     throw __FILE__ " Error: l." TOSTRING(__LINE__) " - " #X
 #define PRT(X) printf("%s\n", X)
 
+/* fast start: the stream's pool in one block, and the released pools
+   cached, for a re-created stream */
+#define STREAM_POOL_SIZE        4000
+#define STREAM_POOL_FAST        48000
+#define POOL_CACHE_FAST         (256 * 1024)
+
+#define SRTP_KEY_MAX            64      // bytes, decoded
+
+/* usec since *lap; *lap moved to now */
+static unsigned lap_us(std::chrono::steady_clock::time_point *lap)
+{
+    auto now = std::chrono::steady_clock::now();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - *lap).count();
+    *lap = now;
+    return (unsigned)us;
+}
+
+/*
+    Run the calling thread under SCHED_FIFO, for the lifetime of the object:
+    the threads it creates, i.e. the master port's clock, inherit the policy
+*/
+class RealtimeScope
+{
+    int policy;
+    sched_param param;
+    bool changed = false;
+
+public:
+    RealtimeScope(int prio)
+    {
+        if (!prio)
+            return;
+        pthread_getschedparam(pthread_self(), &policy, &param);
+        sched_param rt_param = {};
+        rt_param.sched_priority = prio;
+        changed = (pthread_setschedparam(pthread_self(), SCHED_FIFO, &rt_param) == 0);
+        if (!changed)
+            LOG(log_warning, "Warning: failed to set SCHED_FIFO priority %d", prio);
+    }
+    ~RealtimeScope()
+    {
+        if (changed)
+            pthread_setschedparam(pthread_self(), policy, &param);
+    }
+};
+
 RTP_endpoint::RTP_endpoint(pj_uint16_t local_port, int log_level,
-                           pjmedia_dir dir, const char *codec_id) : local_port(local_port)
+                           pjmedia_dir dir, const char *codec_id, bool fast_start) :
+    local_port(local_port), fast_start(fast_start)
 {
+    auto lap = std::chrono::steady_clock::now();
 
     pj_log_set_level(log_level);
     check_status(pj_init());
+    init_times.pjlib = lap_us(&lap);
     /* Must create a pool factory before we can allocate any memory. */
     const pjmedia_codec_info *codec_info;
     // check_status(pj_init());
     check_status(createMemPool());
+    init_times.media = lap_us(&lap);
     // codec initialization
     check_status(init_codecs(&codec_info, codec_id));
+    init_times.codecs = lap_us(&lap);
     /* Create event manager */
     check_status(pjmedia_event_mgr_create(pool, 0, NULL));
 
@@ -37,38 +95,32 @@ RTP_endpoint::RTP_endpoint(pj_uint16_t local_port, int log_level,
     pj_srand(epoch_time);
     info.ssrc = pj_rand();
 
-    /* Create media transport */
+    /* Create media transport; the stream is attached to it through an
+       adapter, so that it can be retargeted in place */
+    pjmedia_transport *udp_transport;
     check_status(pjmedia_transport_udp_create(med_endpt, NULL, local_port,
-                                              0, &transport));
-    /* Get codec default param for info */
-    check_status(pjmedia_codec_mgr_get_default_param(
-        pjmedia_endpt_get_codec_mgr(med_endpt), codec_info, &codec_param));
+                                              0, &udp_transport));
+    check_status(TransportAdapter::create(udp_transport, &transport));
+    init_times.transport = lap_us(&lap);
 }
 
 RTP_endpoint::~RTP_endpoint()
 {
-    /* Destroy master port */
-    if (master_port)
-    {
-        pjmedia_master_port_destroy(master_port, PJ_FALSE);
-    }
+    stopReplay();
 
-    /* Destroy stream */
-    if (stream)
-    {
-        pjmedia_transport *tp;
+    /* Destroy master port and file player */
+    destroyPlayer();
 
-        tp = pjmedia_stream_get_transport(stream);
-        pjmedia_stream_destroy(stream);
+    /* Destroy stream */
+    destroyStream();
 
-        pjmedia_transport_media_stop(tp);
-        pjmedia_transport_close(tp);
+    /* Destroy media transport */
+    if (transport)
+    {
+        pjmedia_transport_media_stop(transport);
+        pjmedia_transport_close(transport);
     }
 
-    /* Destroy file ports */
-    if (play_file_port)
-        pjmedia_port_destroy(play_file_port);
-
     /* Destroy event manager */
     pjmedia_event_mgr_destroy(NULL);
 
@@ -87,8 +139,9 @@ RTP_endpoint::~RTP_endpoint()
 
 pj_status_t RTP_endpoint::init_codecs(const pjmedia_codec_info **codec_info, const char *codec_id)
 {
-    /* Register G.711 codecs */
-    status = pjmedia_codec_g711_init(med_endpt);
+    /* Register G.711 codecs, on the SIMD kernels; on fast start, only
+       the one in use */
+    status = G711Codec::register_factory(med_endpt, (fast_start) ? codec_id : nullptr);
     if (status)
         return status;
 
@@ -103,7 +156,7 @@ pj_status_t RTP_endpoint::init_codecs(const pjmedia_codec_info **codec_info, con
                                                      codec_info, NULL);
         if (status != PJ_SUCCESS)
         {
-            printf("Error: unable to find codec %s\n", codec_id);
+            LOG(log_error, "Error: unable to find codec %s", codec_id);
         }
         return status;
     }
@@ -130,13 +183,17 @@ pj_status_t RTP_endpoint::createMemPool(const char *name,
     if (!increment)
         increment = initial;
 
-    pj_caching_pool_init(&cp, &pj_pool_factory_default_policy, 0);
+    pj_caching_pool_init(&cp, &pj_pool_factory_default_policy,
+                         (fast_start) ? POOL_CACHE_FAST : 0);
 
     /*
      * Initialize media endpoint.
      * This will implicitly initialize PJMEDIA too.
      */
-    status = pjmedia_endpt_create(&cp.factory, NULL, 1, &med_endpt);
+    {
+        ThreadNameScope name("ep-pjmedia");     // its worker thread's
+        status = pjmedia_endpt_create(&cp.factory, NULL, 1, &med_endpt);
+    }
     if (status)
         return status;
 
@@ -151,6 +208,67 @@ pj_status_t RTP_endpoint::createMemPool(const char *name,
     return PJ_SUCCESS;
 }
 
+/* SCHED_FIFO priority of the sender (master port) thread; 0: normal */
+void RTP_endpoint::setRealtime(int prio)
+{
+    rt_prio = prio;
+}
+
+void RTP_endpoint::setDirection(pjmedia_dir dir)
+{
+    /* takes effect on the next createStream() */
+    info.dir = dir;
+}
+
+/* Packet time (ms, a multiple of the codec's frame time; 0: the codec's
+   default) and DTX: silence not sent, but for the codec's periodic
+   refresh. Take effect on the next createStream() */
+void RTP_endpoint::setPacketization(unsigned ptime, bool dtx)
+{
+    this->ptime = ptime;
+    this->dtx = dtx;
+}
+
+/* Kernel timestamps of the RTP packets: received ones if the stream
+   receives, otherwise sent ones. Take effect on the next createStream() */
+void RTP_endpoint::setKernelTimestamps(bool on)
+{
+    kernel_ts = on;
+}
+
+/* One-way delay, between our own endpoints: the sent packets carry their
+   send time, and the received ones' delay is measured. Needs the hosts'
+   clocks synced. Takes effect on the next createStream() */
+void RTP_endpoint::setOneWayDelay(bool on)
+{
+    owd = on;
+}
+
+/* RTCP-XR VoIP Metrics and Statistics Summary blocks, sent along with
+   RTCP, and those of the remote parsed: the remote's view of the sent
+   stream. False if pjmedia is built without RTCP-XR. Takes effect on the
+   next createStream() */
+bool RTP_endpoint::setRtcpXr(bool on)
+{
+    rtcp_xr = on && RTCP_XR_BUILT;
+    return rtcp_xr == on;
+}
+
+/* SRTP crypto suite (empty: plain RTP) and its master key and salt, in
+   base64; the same both ways. Take effect on the next createStream() */
+void RTP_endpoint::setSrtp(const char *suite, const char *key)
+{
+    srtp_suite = suite;
+    srtp_key = key;
+}
+
+/* Impairment of the sent RTP packets; the seed reproduces its draws per
+   stream. Takes effect on the next createStream() */
+void RTP_endpoint::setImpairment(const ImpairProfile &profile)
+{
+    impair = profile;
+}
+
 void RTP_endpoint::setRemoteAddr(const char *ip_addr, pj_uint16_t port)
 {
     // pj_sockaddr_in remote_addr;
@@ -166,34 +284,175 @@ void RTP_endpoint::setRemoteAddr(const char *ip_addr, pj_uint16_t port)
 
 void RTP_endpoint::createStream()
 {
+    if (stream && stream_dir == info.dir && stream_ptime == ptime && stream_dtx == dtx)
+    {
+        /* Reuse: keep stream and transport, only retarget them */
+        info.ssrc = pj_rand();
+        check_status(TransportAdapter::retarget(transport, &remote_addr,
+                                                &info.rem_rtcp.ipv4,
+                                                stream_ssrc, info.ssrc));
+        setTimestamping();
+        startSrtp();
+        TransportAdapter::set_impairment(transport, &impair);
+        return;
+    }
+    destroyStream();
+
+    /* The file player and the clock run at the packet time */
+    if (master_port && stream_ptime != ptime)
+        destroyPlayer();
+
+    /* Codec param: the packetization profile, over the codec's defaults */
+    check_status(pjmedia_codec_mgr_get_default_param(
+        pjmedia_endpt_get_codec_mgr(med_endpt), &info.fmt, &codec_param));
+    if (ptime >= codec_param.info.frm_ptime)
+        codec_param.setting.frm_per_pkt = ptime / codec_param.info.frm_ptime;
+    codec_param.setting.vad = dtx;
+    info.param = &codec_param;
+
+    /* A dedicated pool per stream, so that a re-created stream
+       does not grow the application pool */
+    pj_size_t stream_pool_size = (fast_start) ? STREAM_POOL_FAST : STREAM_POOL_SIZE;
+    stream_pool = pj_pool_create(&cp.factory, "stream", stream_pool_size, STREAM_POOL_SIZE, NULL);
+    if (!stream_pool)
+        throw "Error creating stream pool";
+
+#if RTCP_XR_BUILT
+    info.rtcp_xr_enabled = rtcp_xr;
+#endif
+
     /* Now that the stream info is initialized, we can create the stream.  */
-    status = pjmedia_stream_create(med_endpt, pool, &info,
+    status = pjmedia_stream_create(med_endpt, stream_pool, &info,
                                    transport,
                                    NULL, &stream);
 
     if (status)
     {
         pjmedia_transport_close(transport);
+        transport = NULL;
         throw "Error creating stream";
     }
+    stream_dir = info.dir;
+    stream_ssrc = info.ssrc;
+    stream_ptime = ptime;
+    stream_dtx = dtx;
+    stream_started = false;
     /* Start media transport */
     pjmedia_transport_media_start(transport, 0, 0, 0, 0);
+    setTimestamping();
+    startSrtp();
+    TransportAdapter::set_impairment(transport, &impair);
     /* Get the port interface of the stream */
     check_status(pjmedia_stream_get_port(stream, &stream_port));
+    if (master_port)
+        check_status(pjmedia_master_port_set_dport(master_port, stream_port));
+}
+
+void RTP_endpoint::setTimestamping()
+{
+    kernel_ts_mode mode = (!kernel_ts) ? kts_off :
+                          (info.dir & PJMEDIA_DIR_DECODING) ? kts_rx : kts_tx;
+    status = TransportAdapter::set_timestamping(transport, mode, info.fmt.clock_rate);
+    if (status != PJ_SUCCESS)
+        LOG(log_warning, "Warning: kernel timestamps not available (%d)", status);
+    TransportAdapter::set_owd(transport, (owd) ? OWD_EXT_ID : 0);
+}
+
+/* a new SRTP session per stream, as its SSRC changes */
+void RTP_endpoint::startSrtp()
+{
+    pj_uint8_t key[SRTP_KEY_MAX];
+    int key_len = sizeof(key);
+    pj_str_t key_str = pj_str(const_cast<char *>(srtp_key.c_str()));
+    if (!srtp_suite.empty() && pj_base64_decode(&key_str, key, &key_len) != PJ_SUCCESS)
+        throw "Error decoding the SRTP key";
+
+    pj_str_t raw_key;
+    raw_key.ptr = (char *)key;
+    raw_key.slen = key_len;
+    status = TransportAdapter::set_srtp(transport, med_endpt, srtp_suite.c_str(), &raw_key);
+    if (status != PJ_SUCCESS)
+    {
+        LOG(log_error, "Error starting SRTP %s (%d)", srtp_suite.c_str(), status);
+        throw "Error starting SRTP";
+    }
+}
+
+void RTP_endpoint::destroyStream()
+{
+    if (!stream)
+        return;
+
+    pjmedia_stream_destroy(stream);
+    stream = NULL;
+    pj_pool_release(stream_pool);
+    stream_pool = NULL;
+}
+
+/* The master port and the file player, in a pool of their own: a player
+   re-created for another source or packet time does not grow the
+   application pool */
+void RTP_endpoint::destroyPlayer()
+{
+    if (master_port)
+        pjmedia_master_port_destroy(master_port, PJ_FALSE);
+    master_port = NULL;
+    if (play_file_port)
+        pjmedia_port_destroy(play_file_port);
+    play_file_port = NULL;
+    if (player_pool)
+        pj_pool_release(player_pool);
+    player_pool = NULL;
+    play_source.clear();
+}
+
+void RTP_endpoint::createMasterPort()
+{
+    /* keep the clock thread's priority as set, if realtime */
+    RealtimeScope realtime(rt_prio);
+    ThreadNameScope name("ep-clock");
+    check_status(pjmedia_master_port_create(player_pool, play_file_port, stream_port,
+                                            (rt_prio) ? PJMEDIA_CLOCK_NO_HIGHEST_PRIO : 0,
+                                            &master_port));
 }
 
 void RTP_endpoint::startStream(const char *wavfile)
 {
-    if (wavfile && !play_file_port)
+    if (wavfile && (!play_file_port || play_source != wavfile))
     {
         unsigned wav_ptime;
 
+        destroyPlayer();
+        player_pool = pj_pool_create(&cp.factory, "player", 1000, 1000, NULL);
+        if (!player_pool)
+            throw "Error creating player pool";
         wav_ptime = PJMEDIA_PIA_PTIME(&stream_port->info);
-        check_status(pjmedia_wav_player_port_create(pool, wavfile, wav_ptime,
+        check_status(pjmedia_wav_player_port_create(player_pool, wavfile, wav_ptime,
                                                     0, -1, &play_file_port));
+        createMasterPort();
+        play_source = wavfile;
+    }
+    startStream();
+}
+
+/* A media library source: 16-bit mono PCM, played in a loop from memory,
+   shared by the endpoints playing it; to stay mapped while the player is */
+void RTP_endpoint::startStream(const char *source, const void *pcm, pj_size_t size,
+                               unsigned clock_rate)
+{
+    std::string key = std::string("@") + source;
 
-        check_status(pjmedia_master_port_create(pool, play_file_port, stream_port,
-                                                0, &master_port));
+    if (!play_file_port || play_source != key)
+    {
+        destroyPlayer();
+        player_pool = pj_pool_create(&cp.factory, "player", 1000, 1000, NULL);
+        if (!player_pool)
+            throw "Error creating player pool";
+        check_status(pjmedia_mem_player_create(player_pool, pcm, size, clock_rate, 1,
+                                               PJMEDIA_PIA_SPF(&stream_port->info), 16,
+                                               0, &play_file_port));
+        createMasterPort();
+        play_source = key;
     }
     startStream();
 }
@@ -202,37 +461,215 @@ void RTP_endpoint::startStream()
 {
     // info.ssrc = pj_rand();
 
-    /* Start streaming */
-    check_status(pjmedia_stream_start(stream));
+    /* Start streaming; a retargeted stream is only resumed */
+    if (stream_started)
+    {
+        check_status(pjmedia_stream_resume(stream, info.dir));
+    }
+    else
+    {
+        check_status(pjmedia_stream_start(stream));
+    }
+    stream_started = true;
 
     char addr[PJ_INET_ADDRSTRLEN];
     if (info.dir == PJMEDIA_DIR_DECODING)
-        printf("Stream is active, dir is recv-only, local port is %d\n",
-               local_port);
+        LOG(log_info, "Stream is active, dir is recv-only, local port is %d",
+            local_port);
     else if (info.dir == PJMEDIA_DIR_ENCODING)
-        printf("Stream is active, dir is send-only, sending to %s:%d\n",
-               pj_inet_ntop2(pj_AF_INET(), &remote_addr.sin_addr, addr,
-                             sizeof(addr)),
-               pj_ntohs(remote_addr.sin_port));
+        LOG(log_info, "Stream is active, dir is send-only, sending to %s:%d",
+            pj_inet_ntop2(pj_AF_INET(), &remote_addr.sin_addr, addr,
+                          sizeof(addr)),
+            pj_ntohs(remote_addr.sin_port));
     else
-        printf("Stream is active, send/recv, local port is %d, "
-               "sending to %s:%d\n",
-               local_port,
-               pj_inet_ntop2(pj_AF_INET(), &remote_addr.sin_addr, addr,
-                             sizeof(addr)),
-               pj_ntohs(remote_addr.sin_port));
+        LOG(log_info, "Stream is active, send/recv, local port is %d, "
+            "sending to %s:%d",
+            local_port,
+            pj_inet_ntop2(pj_AF_INET(), &remote_addr.sin_addr, addr,
+                          sizeof(addr)),
+            pj_ntohs(remote_addr.sin_port));
+    LOG(log_debug, "Packetization: %u ms packets, DTX %s",
+        codec_param.info.frm_ptime * codec_param.setting.frm_per_pkt,
+        (codec_param.setting.vad) ? "on" : "off");
 }
 
 void RTP_endpoint::stopStreaming()
 {
     check_status(pjmedia_master_port_stop(master_port));
+    check_status(pjmedia_stream_pause(stream, info.dir));
 }
 void RTP_endpoint::startStreaming()
 {
+    RealtimeScope realtime(rt_prio);
 
     check_status(pjmedia_master_port_start(master_port));
 }
 
+/* Replay an RTP flow of a capture to the remote address, in place of the
+   stream's own sending: the stream is to be started, but not streaming */
+void RTP_endpoint::startReplay(const PcapReplay *pcap, double speed)
+{
+    stopReplay();
+    replay_stop = false;
+    replay_sent = 0;
+    pj_gettimeofday(&replay_start);
+
+    /* the replay thread inherits the priority, if realtime */
+    RealtimeScope realtime(rt_prio);
+    replay_thread = std::thread(&RTP_endpoint::replay, this, pcap, speed);
+}
+
+void RTP_endpoint::stopReplay()
+{
+    if (!replay_thread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lk(replay_m);
+        replay_stop = true;
+    }
+    replay_cv.notify_one();
+    replay_thread.join();
+}
+
+/*
+    Send the capture's packets at their capture times, scaled by speed, as
+    an RTP session of this stream: its SSRC, and random sequence/timestamp
+    bases, keeping the capture's gaps. The capture is looped, each loop
+    continuing the sequence and the timestamps.
+*/
+void RTP_endpoint::replay(const PcapReplay *pcap, double speed)
+{
+    pj_thread_desc thread_desc;
+    pj_thread_t *pj_thread;
+    pj_bzero(thread_desc, sizeof(thread_desc));
+    pj_thread_register("replay", thread_desc, &pj_thread);
+    set_thread_name("ep-replay");
+
+    const ReplayPacket &first = pcap->packet(0);
+    const ReplayPacket &last = pcap->packet(pcap->count() - 1);
+    pj_uint16_t seq_base = (pj_uint16_t)pj_rand();
+    pj_uint32_t ts_base = (pj_uint32_t)pj_rand();
+    pj_uint32_t ssrc = info.ssrc;
+    pj_uint64_t loop_start_ns = 0;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lk(replay_m);
+    while (true)
+    {
+        for (size_t i = 0; i < pcap->count(); i++)
+        {
+            const ReplayPacket &pkt = pcap->packet(i);
+            std::chrono::steady_clock::time_point due = start + std::chrono::nanoseconds(
+                (long long)((loop_start_ns + pkt.time_ns) / speed));
+            if (replay_cv.wait_until(lk, due, [this] { return replay_stop; }))
+                return;
+            if (pkt.len > sizeof(replay_buf))
+                continue;
+
+            /* RTP header: seq at 2, timestamp at 4, SSRC at 8 */
+            pj_uint8_t *p = replay_buf;
+            pj_memcpy(p, pcap->data(pkt), pkt.len);
+            pj_uint16_t seq = pkt.seq - first.seq + seq_base;
+            pj_uint32_t ts = pkt.ts - first.ts + ts_base;
+            p[2] = seq >> 8;    p[3] = seq;
+            p[4] = ts >> 24;    p[5] = ts >> 16;    p[6] = ts >> 8;    p[7] = ts;
+            p[8] = ssrc >> 24;  p[9] = ssrc >> 16;  p[10] = ssrc >> 8; p[11] = ssrc;
+
+            pjmedia_transport_send_rtp(transport, p, pkt.len);
+            replay_sent++;
+        }
+        loop_start_ns += pcap->loop_ns();
+        seq_base += (pj_uint16_t)(last.seq - first.seq + 1);
+        ts_base += pcap->loop_ts();
+    }
+}
+
+/* memory currently held by the endpoint's pools */
+pj_size_t RTP_endpoint::getPoolUsage() const
+{
+    return cp.used_size;
+}
+
+/* packets/s sent - received, if recv-only - since the stats' last reset,
+   or since the replay started */
+float RTP_endpoint::getPacketRate() const
+{
+    pjmedia_rtcp_stat stat;
+    pj_time_val elapsed;
+
+    if (replay_thread.joinable())
+    {
+        pj_gettimeofday(&elapsed);
+        PJ_TIME_VAL_SUB(elapsed, replay_start);
+        long ms = PJ_TIME_VAL_MSEC(elapsed);
+        return (ms > 0) ? replay_sent * 1000.0 / ms : 0.0;
+    }
+    if (!stream)
+        return 0.0;
+    pjmedia_stream_get_stat(stream, &stat);
+    pj_gettimeofday(&elapsed);
+    PJ_TIME_VAL_SUB(elapsed, stat.start);
+    long ms = PJ_TIME_VAL_MSEC(elapsed);
+    unsigned pkts = (info.dir & PJMEDIA_DIR_ENCODING) ? stat.tx.pkt : stat.rx.pkt;
+    return (ms > 0) ? pkts * 1000.0 / ms : 0.0;
+}
+
+/* when the first RTP packet was sent or received (CLOCK_MONOTONIC, ns);
+   0 if none yet */
+pj_uint64_t RTP_endpoint::getFirstPacketTime() const
+{
+    return TransportAdapter::first_packet_time(transport);
+}
+
+/* cb(arg) called at the first RTP packet, from the media threads */
+void RTP_endpoint::onFirstPacket(void (*cb)(void *), void *arg)
+{
+    TransportAdapter::on_first_packet(transport, cb, arg);
+}
+
+/* SRTP protect/unprotect CPU time, since the endpoint's first SRTP stream */
+void RTP_endpoint::getSrtpStat(SrtpStat *stat) const
+{
+    TransportAdapter::get_srtp_stat(transport, stat);
+}
+
+/* the sent packets impaired, since the endpoint's first stream */
+void RTP_endpoint::getImpairStat(ImpairStat *stat) const
+{
+    TransportAdapter::get_impair_stat(transport, stat);
+}
+
+/* the RTCP-XR statistics, since the stream's creation: rx, of the received
+   stream, as sent to the remote; tx, the remote's of the sent stream.
+   False if RTCP-XR is off */
+bool RTP_endpoint::getXrStat(pjmedia_rtcp_xr_stat *stat) const
+{
+#if RTCP_XR_BUILT
+    if (rtcp_xr && stream && pjmedia_stream_get_stat_xr(stream, stat) == PJ_SUCCESS)
+        return true;
+#endif
+    PJ_UNUSED_ARG(stat);
+    return false;
+}
+
+/* the one-way delay statistics, since the last reset; false if not measured */
+bool RTP_endpoint::getOwdStat(OwdStat *stat, bool reset) const
+{
+    if (!owd)
+        return false;
+    TransportAdapter::get_owd_stat(transport, stat, reset);
+    return true;
+}
+
+/* the kernel timestamps' statistics, since the last reset; false if none */
+bool RTP_endpoint::getKernelTsStat(KernelTsStat *stat, bool reset) const
+{
+    if (!kernel_ts)
+        return false;
+    TransportAdapter::get_timestamp_stat(transport, stat, reset);
+    return true;
+}
+
 const char *RTP_endpoint::good_number(char *buf, unsigned buf_size, pj_int32_t val)
 {
     if (val < 1000)
@@ -275,39 +712,123 @@ float RTP_endpoint::compute_MOS(float pkt_loss_rate, float rtt) const
     return 1 + 0.035 * R + R * (R - 60) * (100 - R) * 7e-6;
 }
 
+/*
+    MOS of a single direction of the stream
+    PJMEDIA_DIR_ENCODING: the sent stream, as reported back by the remote RTCP
+    PJMEDIA_DIR_DECODING: the received stream; of its one-way delay, if
+    measured, rather than the RTT
+    xr_loss: the sent stream's loss rate (0-1) from the remote's RTCP-XR,
+    if any (>= 0): its loss and its discards (late packets, dropped by the
+    jitter buffer) both count
+*/
+float RTP_endpoint::compute_MOS(const pjmedia_rtcp_stat &stat, pjmedia_dir dir, const OwdStat *owd,
+                                float xr_loss) const
+{
+    if ((dir == PJMEDIA_DIR_DECODING)? stat.rx.update_cnt == 0 : stat.tx.update_cnt == 0)
+        return 0.0;
+    float pkg_loss_rate = loss_rate(stat, dir, xr_loss);
+
+    if (dir == PJMEDIA_DIR_DECODING && owd && owd->owd.n)
+        return compute_MOS(pkg_loss_rate, owd->owd.mean / 1000.0);
+    return compute_MOS(pkg_loss_rate, stat.rtt.mean / 1000.0);
+}
+
+/* the packet loss rate (0-1) of a direction, as in compute_MOS() */
+float RTP_endpoint::loss_rate(const pjmedia_rtcp_stat &stat, pjmedia_dir dir, float xr_loss)
+{
+    if (dir == PJMEDIA_DIR_DECODING)
+        return (stat.rx.pkt) ? (float)stat.rx.loss / (stat.rx.pkt + stat.rx.loss) : 0.0;
+    if (xr_loss >= 0)
+        return xr_loss;
+    return (stat.tx.pkt) ? (float)stat.tx.loss / (stat.tx.pkt) : 0.0;
+}
+
+/*
+    The sent stream's loss rate (0-1) from the remote's RTCP-XR, over the
+    reports since the last call, as the RTCP statistics: RFC 3611 counts
+    since the stream's start, so of their deltas. The discards are counted
+    from their rate. -1 if no report came meanwhile
+*/
+float RTP_endpoint::xr_interval_loss(const pjmedia_rtcp_xr_stream_stat &xr) const
+{
+    if (!xr.stat_sum.update.sec)
+        return -1;
+    pj_uint32_t expected = xr.stat_sum.end_seq - xr.stat_sum.begin_seq;
+    double lost = xr.stat_sum.lost;
+    if (xr.voip_mtc.update.sec)
+        lost += expected * xr.voip_mtc.discard_rate / 256.0;
+    if (expected < xr_last_expected) {
+        // a new stream
+        xr_last_expected = 0;
+        xr_last_lost = 0;
+    }
+    if (expected == xr_last_expected)
+        return -1;
+    double rate = (lost - xr_last_lost) / (expected - xr_last_expected);
+    xr_last_expected = expected;
+    xr_last_lost = lost;
+    return std::min(std::max(rate, 0.0), 1.0);
+}
+
 float RTP_endpoint::get_MOS() const
 {
-    pjmedia_port *port;
+    float tx_mos, rx_mos;
+
+    get_MOS(&tx_mos, &rx_mos);
+    return (info.dir == PJMEDIA_DIR_ENCODING) ? tx_mos : rx_mos;
+}
+
+void RTP_endpoint::get_MOS(float *tx_mos, float *rx_mos) const
+{
+    StreamQuality tx, rx;
+
+    get_quality(&tx, &rx);
+    *tx_mos = tx.mos;
+    *rx_mos = rx.mos;
+}
+
+/* MOS, loss (%) and jitter (ms) of each direction, over the statistics
+   since the last call, which are then reset; a MOS of 0 if the direction
+   is not measured */
+void RTP_endpoint::get_quality(StreamQuality *tx, StreamQuality *rx) const
+{
     pjmedia_rtcp_stat stat;
+    OwdStat owd_stat;
+    pjmedia_rtcp_xr_stat xr_stat;
 
     pjmedia_stream_get_stat(stream, &stat);
-    pjmedia_stream_get_port(stream, &port);
+    bool has_owd = getOwdStat(&owd_stat, false);
+    bool has_xr = getXrStat(&xr_stat);
+    float xr_loss = (has_xr) ? xr_interval_loss(xr_stat.tx) : -1;
 
-    float mos;
-
-    if (info.dir == PJMEDIA_DIR_DECODING)
-    {
-        if (stat.rx.update_cnt == 0)
-            mos = 0.0;
-        else {
-            float pkg_loss_rate = (stat.rx.pkt) ? stat.rx.loss / (stat.rx.pkt + stat.rx.loss) : 0.0;
-            mos = compute_MOS(pkg_loss_rate, stat.rtt.mean / 1000.0);
-        }
+    *tx = {};
+    *rx = {};
+    if (info.dir & PJMEDIA_DIR_ENCODING) {
+        tx->mos = compute_MOS(stat, PJMEDIA_DIR_ENCODING, nullptr, xr_loss);
+        tx->loss_pct = loss_rate(stat, PJMEDIA_DIR_ENCODING, xr_loss) * 100;
+        tx->jitter_ms = stat.tx.jitter.mean / 1000.0;
     }
-
-    if (info.dir == PJMEDIA_DIR_ENCODING)
-    {
-        if (stat.tx.update_cnt == 0)
-            mos = 0.0;
-        else {
-            float pkg_loss_rate = (stat.tx.pkt) ? stat.tx.loss / (stat.tx.pkt) : 0.0;
-            mos = compute_MOS(pkg_loss_rate, stat.rtt.mean / 1000.0);
-        }
+    if (info.dir & PJMEDIA_DIR_DECODING) {
+        rx->mos = compute_MOS(stat, PJMEDIA_DIR_DECODING, (has_owd) ? &owd_stat : nullptr);
+        rx->loss_pct = loss_rate(stat, PJMEDIA_DIR_DECODING, -1) * 100;
+        rx->jitter_ms = stat.rx.jitter.mean / 1000.0;
     }
 
     pjmedia_stream_reset_stat(stream);
-    return mos;
+}
 
+/* RTCP-XR VoIP metrics of a direction; rates in 1/256 */
+static void print_xr(const char *label, const pjmedia_rtcp_xr_stream_stat &xr)
+{
+    if (!xr.voip_mtc.update.sec)
+        return;
+    printf(" %s: loss %.1f%%, discard %.1f%%, burst %.1f%% for %u ms, gap %.1f%% for %u ms, "
+           "RTT %u ms, end system delay %u ms, jitter buffer %u/%u ms\n",
+           label, xr.voip_mtc.loss_rate * 100 / 256.0, xr.voip_mtc.discard_rate * 100 / 256.0,
+           xr.voip_mtc.burst_den * 100 / 256.0, xr.voip_mtc.burst_dur,
+           xr.voip_mtc.gap_den * 100 / 256.0, xr.voip_mtc.gap_dur,
+           xr.voip_mtc.rnd_trip_delay, xr.voip_mtc.end_sys_delay,
+           xr.voip_mtc.jb_nom, xr.voip_mtc.jb_max);
 }
 
 void RTP_endpoint::print_stream_stat() const
@@ -343,7 +864,7 @@ void RTP_endpoint::print_stream_stat() const
            duration);
 #endif
 
-    if (info.dir == PJMEDIA_DIR_DECODING)
+    if (info.dir & PJMEDIA_DIR_DECODING)
     {
         if (stat.rx.update_cnt == 0)
             pj_ansi_strxcpy(last_update, "never", sizeof(last_update));
@@ -394,7 +915,7 @@ void RTP_endpoint::print_stream_stat() const
                compute_MOS(pkg_loss_rate, stat.rtt.mean / 1000.0));
     }
 
-    if (info.dir == PJMEDIA_DIR_ENCODING)
+    if (info.dir & PJMEDIA_DIR_ENCODING)
     {
         if (stat.tx.update_cnt == 0)
             pj_ansi_strxcpy(last_update, "never", sizeof(last_update));
@@ -444,6 +965,75 @@ void RTP_endpoint::print_stream_stat() const
                compute_MOS(pkg_loss_rate, stat.rtt.mean / 1000.0));
     }
 
+    KernelTsStat ts_stat;
+    if (getKernelTsStat(&ts_stat, false))
+    {
+        const struct { const char *name; const pj_math_stat *stat; } kernel[] = {
+            {"RX jitter   ", &ts_stat.rx_jitter},
+            {"RX interarr.", &ts_stat.rx_interarrival},
+            {"RX host dly.", &ts_stat.rx_host_delay},
+            {"TX jitter   ", &ts_stat.tx_jitter},
+            {"TX host dly.", &ts_stat.tx_host_delay},
+        };
+        puts(" Kernel timestamps (msec)  min     avg     max     last    dev");
+        for (const auto &k : kernel)
+            if (k.stat->n)
+                printf("    %s: %7.3f %7.3f %7.3f %7.3f %7.3f\n", k.name,
+                       k.stat->min / 1000.0, k.stat->mean / 1000.0, k.stat->max / 1000.0,
+                       k.stat->last / 1000.0, pj_math_stat_get_stddev(k.stat) / 1000.0);
+    }
+
+    OwdStat owd_stat;
+    if (getOwdStat(&owd_stat, false) && owd_stat.owd.n)
+    {
+        printf(" One-way delay : %7.3f %7.3f %7.3f %7.3f %7.3f\n"
+               "    p50/p95/p99 under: %.1f/%.1f/%.1f ms\n    histogram (ms):",
+               owd_stat.owd.min / 1000.0,
+               owd_stat.owd.mean / 1000.0,
+               owd_stat.owd.max / 1000.0,
+               owd_stat.owd.last / 1000.0,
+               pj_math_stat_get_stddev(&owd_stat.owd) / 1000.0,
+               owd_percentile(&owd_stat, 50) / 1000.0,
+               owd_percentile(&owd_stat, 95) / 1000.0,
+               owd_percentile(&owd_stat, 99) / 1000.0);
+        for (int i = 0; i < OWD_BUCKETS - 1; i++)
+            if (owd_stat.hist[i])
+                printf(" <=%g: %u", owd_bucket_us[i] / 1000.0, owd_stat.hist[i]);
+        if (owd_stat.hist[OWD_BUCKETS - 1])
+            printf(" more: %u", owd_stat.hist[OWD_BUCKETS - 1]);
+        puts("");
+    }
+
+    SrtpStat srtp_stat;
+    getSrtpStat(&srtp_stat);
+    if (!srtp_suite.empty())
+        printf(" SRTP %s: protect %lu pkts, %.3f ms CPU (%.0f ns/pkt), "
+               "unprotect %lu pkts, %.3f ms CPU (%.0f ns/pkt), %lu failed\n",
+               srtp_suite.c_str(),
+               srtp_stat.protect_pkts, srtp_stat.protect_ns / 1e6,
+               (srtp_stat.protect_pkts) ? (double)srtp_stat.protect_ns / srtp_stat.protect_pkts : 0.0,
+               srtp_stat.unprotect_pkts, srtp_stat.unprotect_ns / 1e6,
+               (srtp_stat.unprotect_pkts) ? (double)srtp_stat.unprotect_ns / srtp_stat.unprotect_pkts : 0.0,
+               srtp_stat.unprotect_fail);
+
+    ImpairStat impair_stat;
+    getImpairStat(&impair_stat);
+    if (impair_active(&impair))
+        printf(" Impairment    : %lu pkts, %lu lost, %lu duplicated, %lu reordered, "
+               "%.3f ms mean added delay (%s)\n",
+               impair_stat.packets, impair_stat.lost, impair_stat.duplicated,
+               impair_stat.reordered,
+               (impair_stat.packets > impair_stat.lost) ?
+                   impair_stat.delay_us / 1000.0 / (impair_stat.packets - impair_stat.lost) : 0.0,
+               jitter_dist_name(impair.jitter_dist));
+
+    pjmedia_rtcp_xr_stat xr_stat;
+    if (getXrStat(&xr_stat))
+    {
+        print_xr("RTCP-XR RX   ", xr_stat.rx);
+        print_xr("RTCP-XR TX   ", xr_stat.tx);
+    }
+
     printf(" RTT delay     : %7.3f %7.3f %7.3f %7.3f %7.3f%s\n",
            stat.rtt.min / 1000.0,
            stat.rtt.mean / 1000.0,
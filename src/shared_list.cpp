@@ -3,16 +3,26 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <errno.h>
 #include <stdexcept>
 #include "shared_list.h"
 
 inline char* print_elmnt(Data *data)
 {
-    static char sz_out[200];
+    static thread_local char sz_out[640];
     snprintf(sz_out, sizeof(sz_out),
-        "source port: %-8d dest port: %-8d dest addr: %-16s duration: %-8d pid: %-8d client: %-8d",
-        data->port, data->dest_port, data->dest_address, data->duration, data->pid, data->client);
+        "source port: %-8d dest port: %-8d dest addr: %-16s duration: %-8d pid: %-8d client: %-8d bidir: %-8d "
+        "pool: %-8u state: %-8s reused: %-8u cpu: %-4d cpu time (us): %-10llu mem: %-10llu "
+        "ptime: %-4u dtx: %-2u pps: %-8.1f startup (us): %-8u srtp: %-24s source: %-12s profile: %-12s tag: %s",
+        data->port, data->dest_port, data->dest_address, data->duration, data->pid, data->client,
+        data->bidir, data->pool_used,
+        (data->state == ep_idle)? "idle" : (data->state == ep_released)? "released" : "active",
+        data->reuse_cnt, data->cpu, data->cpu_usec, data->mem_bytes,
+        data->ptime, data->dtx, data->pps, data->startup_us[sp_total],
+        (data->srtp[0])? data->srtp : "off", (data->source[0])? data->source : "-",
+        (data->profile[0])? data->profile : "-", (data->tag[0])? data->tag : "-");
     return sz_out;
 }
 
@@ -36,12 +46,14 @@ SharedList::SharedList(type_t type, const char* shared_mem_name) : type(type)
             flags = O_CREAT | O_RDWR;
         }
 
-        // Create shared memory
-        int fd = shm_open(shared_mem_name, flags, 0666);
+        // Create shared memory; the owner's only, as it holds SRTP keys
+        int fd = shm_open(shared_mem_name, flags, 0600);
         if (fd == -1) {
             throw std::runtime_error("Failed to open shared Memory " +
                 std::string(shared_mem_name));
         }
+        if (type != t_client)
+            fchmod(fd, 0600);       // also a registry kept from a restart
 
         if ( ftruncate(fd, sizeof(SharedLst)) == -1 ) {
             throw std::runtime_error("Failed to truncate memory: "
@@ -66,11 +78,11 @@ SharedList::~SharedList()
             if (mutex_acquired)
                 unlock();
 
-            if (mutex_initialized)
+            if (mutex_initialized && !persistent)
                 pthread_mutex_destroy(&list->mutex);
             munmap(list, sizeof(SharedLst));
         }
-        if (type == t_server)
+        if (type == t_server && !persistent)
             shm_unlink(shared_mem_name);
         }
 }
@@ -80,6 +92,8 @@ void SharedList::initialize()
     pthread_mutexattr_t mutex_attr;
     pthread_mutexattr_init(&mutex_attr);
     pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+    // a process dying with the lock held does not block the others
+    pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
     pthread_mutex_init(&list->mutex, &mutex_attr);
     mutex_initialized = true;
 
@@ -90,11 +104,70 @@ void SharedList::initialize()
     list->nodes[MAX_NODES-1].next = -1;
     list->head = 0;
     list->count = 0;
+    list->seq = 0;
+
+    list->magic = SHM_MAGIC;
+    list->version = SHM_VERSION;
+    list->size = sizeof(SharedLst);
+}
+
+// Take over the list of a previous server (warm restart): validate it, and
+// keep the elements whose process is alive.
+// Returns the number of adopted elements; -1 if the list is not valid
+// and should be initialized.
+int SharedList::adopt(bool (*alive)(pid_t pid))
+{
+    if (list->magic != SHM_MAGIC || list->version != SHM_VERSION ||
+        list->size != sizeof(SharedLst))
+        return -1;
+
+    lock();
+    if (!consistent()) {
+        unlock();
+        return -1;
+    }
+
+    Data *elements[MAX_NODES];
+    int count = fetch_elements(elements, MAX_NODES);
+    for (int i = 0; i < count; i++)
+        if (!alive(elements[i]->pid))
+            remove_element(elements[i]->port);
+    count = list->count;
+    unlock();
+
+    return count;
+}
+
+// the list's links stay within the nodes
+bool SharedList::consistent() const
+{
+    if (list->count < 0 || list->count > MAX_NODES ||
+        list->head < 0 || list->head >= MAX_NODES)
+        return false;
+
+    short h = list->head;
+    for (int i = 0; i < list->count - 1; i++) {
+        h = list->nodes[h].next;
+        if (h < 0 || h >= MAX_NODES)
+            return false;
+    }
+    return true;
+}
+
+void SharedList::persist()
+{
+    persistent = true;
 }
 
 void SharedList::lock()
 {
-    if(!pthread_mutex_lock(&list->mutex)) {
+    int rc = pthread_mutex_lock(&list->mutex);
+    if (rc == EOWNERDEAD) {
+        // the previous owner died holding it
+        pthread_mutex_consistent(&list->mutex);
+        rc = 0;
+    }
+    if(!rc) {
         mutex_acquired = true;
     }
 }
@@ -128,6 +201,7 @@ int SharedList::update_element(Data *data)
     Data *d = fetch_element(data->port);
     if(d) {
         memcpy(d, data, sizeof(Data));
+        record(jr_update, d);
         return SUCCESS;
     }
     else
@@ -145,6 +219,7 @@ int SharedList::add_element(Data *data)
     }
     memcpy(&temp->data, data, sizeof(Data));
     list->count++;
+    record(jr_add, &temp->data);
     return SUCCESS;
 }
 int SharedList::remove_element(int port)
@@ -162,6 +237,7 @@ int SharedList::remove_element(int port)
         temp = list->nodes+h;
     }
     if (!found) return ERROR;
+    record(jr_remove, &temp->data);
 
     if (h == list->head) {
         list->head = temp->next;
@@ -192,3 +268,67 @@ Data* SharedList::fetch_element(int port) const
 
 }
 
+// collect pointers to (at most max) elements, in list order
+int SharedList::fetch_elements(Data **elements, int max) const
+{
+    ListNode *n;
+    int i = 0;
+    for(int h = list->head; i < list->count && i < max; i++, h=n->next) {
+        n = list->nodes+h;
+        elements[i] = &n->data;
+    }
+    return i;
+}
+
+
+void SharedList::record(journal_op op, const Data *data)
+{
+    unsigned long long seq = list->seq + 1;
+    JournalEvent *event = list->journal + (seq % JOURNAL_SZ);
+    event->seq = seq;
+    event->op = op;
+    memcpy(&event->data, data, sizeof(Data));
+    // the key stays in its entry, for its endpoint only
+    memset(event->data.srtp_key, 0, sizeof(event->data.srtp_key));
+    __atomic_store_n(&list->seq, seq, __ATOMIC_RELEASE);
+}
+
+void SharedList::touch(Data *data)
+{
+    record(jr_update, data);
+}
+
+// copy (at most max) elements, to be used outside the lock;
+// returns the journal seq they are consistent with
+unsigned long long SharedList::snapshot(Data *elements, int max, int *count) const
+{
+    ListNode *n;
+    int i = 0;
+    for(int h = list->head; i < list->count && i < max; i++, h=n->next) {
+        n = list->nodes+h;
+        memcpy(elements + i, &n->data, sizeof(Data));
+    }
+    *count = i;
+    return list->seq;
+}
+
+// copy (at most max) events after since, in order; seq is set to the last one.
+// Returns -1 if the journal no longer holds them all: take a snapshot instead.
+int SharedList::changes(unsigned long long since, JournalEvent *events, int max,
+                        unsigned long long *seq) const
+{
+    if (since > list->seq || list->seq - since > JOURNAL_SZ)
+        return -1;
+
+    int i = 0;
+    for (unsigned long long s = since + 1; s <= list->seq && i < max; s++, i++)
+        memcpy(events + i, list->journal + (s % JOURNAL_SZ), sizeof(JournalEvent));
+    *seq = since + i;
+    return i;
+}
+
+// lock-free read, e.g. to poll for changes
+unsigned long long SharedList::journal_seq() const
+{
+    return __atomic_load_n(&list->seq, __ATOMIC_ACQUIRE);
+}
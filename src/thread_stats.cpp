@@ -0,0 +1,180 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include "thread_stats.h"
+
+// the threads' names, by prefix, and what they do
+static const struct { const char *prefix; const char *subsystem; } subsystems[] = {
+    {"ms-http",     "http"},        // Pistache's reactor and listener
+    {"ms-worker",   "worker"},      // spawns (fork, exec) and reuses
+    {"ms-housekeep", "housekeeping"},
+    {"ms-status",   "status"},      // /status long-polls
+    {"ms-plan",     "plan"},        // call plan
+    {"ep-stream",   "stream"},      // stream set-up, reports and InfluxDB
+    {"ep-pjmedia",  "pjmedia"},     // media endpoint's ioqueue: RTP/RTCP in
+    {"ep-clock",    "clock"},       // master port's clock: the media out
+    {"ep-replay",   "replay"},
+    {"ep-impair",   "impairment"},
+    {"log-drain",   "logging"},
+};
+
+// pjlib's own names for them, if it names its threads: whole names, as
+// "media" would also be the prefix of the processes' names
+static const struct { const char *name; const char *subsystem; } pj_names[] = {
+    {"media",       "pjmedia"},
+    {"clock",       "clock"},
+};
+
+void set_thread_name(const char *name)
+{
+    char truncated[THREAD_NAME_SZ];
+    snprintf(truncated, sizeof(truncated), "%s", name);
+    pthread_setname_np(pthread_self(), truncated);
+}
+
+ThreadNameScope::ThreadNameScope(const char *name)
+{
+    if (pthread_getname_np(pthread_self(), saved, sizeof(saved)) == 0)
+        set_thread_name(name);
+    else
+        saved[0] = 0;
+}
+
+ThreadNameScope::~ThreadNameScope()
+{
+    if (saved[0])
+        pthread_setname_np(pthread_self(), saved);
+}
+
+const char *thread_subsystem(const std::string& name, bool main_thread)
+{
+    if (main_thread)
+        return "main";
+    for (const auto& s : subsystems)
+        if (!name.compare(0, strlen(s.prefix), s.prefix))
+            return s.subsystem;
+    for (const auto& s : pj_names)
+        if (name == s.name)
+            return s.subsystem;
+    return "other";
+}
+
+static bool read_line(const std::string& path, char *buf, size_t size)
+{
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f)
+        return false;
+    bool ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    return ok;
+}
+
+// a thread's figures; false if it is gone
+static bool read_thread(const std::string& task, ThreadStat *stat)
+{
+    static const long ticks = sysconf(_SC_CLK_TCK);
+    char buf[512];
+
+    if (!read_line(task + "/comm", buf, sizeof(buf)))
+        return false;
+    buf[strcspn(buf, "\n")] = 0;
+    stat->name = buf;
+
+    // past the name, which may hold spaces and parentheses: state, then
+    // utime and stime, the 14th and 15th fields
+    unsigned long long utime = 0, stime = 0;
+    if (!read_line(task + "/stat", buf, sizeof(buf)))
+        return false;
+    const char *fields = strrchr(buf, ')');
+    if (!fields || sscanf(fields + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                          &stat->state, &utime, &stime) != 3)
+        return false;
+    stat->user_us = utime * 1000000 / ticks;
+    stat->system_us = stime * 1000000 / ticks;
+
+    FILE *f = fopen((task + "/status").c_str(), "r");
+    if (f) {
+        while (fgets(buf, sizeof(buf), f)) {
+            sscanf(buf, "voluntary_ctxt_switches: %lu", &stat->voluntary);
+            sscanf(buf, "nonvoluntary_ctxt_switches: %lu", &stat->involuntary);
+        }
+        fclose(f);
+    }
+    // only with the kernel's schedstats
+    if (read_line(task + "/schedstat", buf, sizeof(buf)))
+        sscanf(buf, "%llu %llu %llu", &stat->run_ns, &stat->wait_ns, &stat->timeslices);
+    return true;
+}
+
+std::vector<ThreadStat> thread_stats(pid_t pid)
+{
+    if (!pid)
+        pid = getpid();
+    std::string dir = "/proc/" + std::to_string(pid) + "/task";
+    std::vector<ThreadStat> threads;
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        return threads;
+    while (struct dirent *entry = readdir(d)) {
+        if (entry->d_name[0] == '.')
+            continue;
+        ThreadStat stat = {};
+        stat.tid = atoi(entry->d_name);
+        if (!read_thread(dir + "/" + entry->d_name, &stat))
+            continue;
+        stat.subsystem = thread_subsystem(stat.name, stat.tid == pid);
+        threads.push_back(stat);
+    }
+    closedir(d);
+    return threads;
+}
+
+std::string thread_report(const std::vector<ThreadStat>& threads)
+{
+    struct Total { unsigned threads; unsigned long long cpu_us; unsigned long switches; };
+    std::map<std::string, Total> totals;
+    std::string output;
+    char line[384];
+    for (const ThreadStat& t : threads) {
+        snprintf(line, sizeof(line),
+            "tid: %-8d name: %-15s subsystem: %-12s state: %c cpu user (ms): %-8llu "
+            "cpu system (ms): %-8llu voluntary switches: %-8lu involuntary switches: %-8lu "
+            "run delay (ms): %-8llu timeslices: %llu\n",
+            t.tid, t.name.c_str(), t.subsystem, t.state, t.user_us / 1000, t.system_us / 1000,
+            t.voluntary, t.involuntary, t.wait_ns / 1000000, t.timeslices);
+        output += line;
+        Total& total = totals[t.subsystem];
+        total.threads++;
+        total.cpu_us += t.user_us + t.system_us;
+        total.switches += t.voluntary + t.involuntary;
+    }
+    for (const auto& total : totals) {
+        snprintf(line, sizeof(line), "%s threads: %u cpu (ms): %llu switches: %lu\n",
+            total.first.c_str(), total.second.threads, total.second.cpu_us / 1000,
+            total.second.switches);
+        output += line;
+    }
+    return output;
+}
+
+std::string thread_report_json(pid_t pid, const std::vector<ThreadStat>& threads)
+{
+    std::string output = "{\"pid\":" + std::to_string((pid)? pid : getpid()) + ",\"threads\":[";
+    char thread[384];
+    for (size_t i = 0; i < threads.size(); i++) {
+        const ThreadStat& t = threads[i];
+        // the names are ours, or pjlib's: no quotes
+        snprintf(thread, sizeof(thread),
+            "%s{\"tid\":%d,\"name\":\"%s\",\"subsystem\":\"%s\",\"state\":\"%c\","
+            "\"user_us\":%llu,\"system_us\":%llu,\"voluntary\":%lu,\"involuntary\":%lu,"
+            "\"run_ns\":%llu,\"wait_ns\":%llu,\"timeslices\":%llu}",
+            (i)? "," : "", t.tid, t.name.c_str(), t.subsystem, t.state, t.user_us, t.system_us,
+            t.voluntary, t.involuntary, t.run_ns, t.wait_ns, t.timeslices);
+        output += thread;
+    }
+    return output + "]}\n";
+}
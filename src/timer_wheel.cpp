@@ -0,0 +1,53 @@
+#include "timer_wheel.h"
+
+TimerWheel::TimerWheel(unsigned tick_ms, unsigned slots, unsigned long long now_ms)
+    : wheel(slots), tick_ms(tick_ms), origin_ms(now_ms)
+{
+}
+
+void TimerWheel::schedule(unsigned delay_ms, Callback callback)
+{
+    // at least the next tick
+    unsigned long long ticks = (delay_ms + tick_ms - 1) / tick_ms;
+    if (!ticks)
+        ticks = 1;
+    wheel[(current + ticks) % wheel.size()].push_back(
+        Timer{(ticks - 1) / wheel.size(), callback});
+    count++;
+}
+
+void TimerWheel::advance(unsigned long long now_ms)
+{
+    unsigned long long target = (now_ms - origin_ms) / tick_ms;
+    while (current < target) {
+        current++;
+        // the callbacks may schedule new timers, in this slot too
+        std::vector<Timer> slot;
+        slot.swap(wheel[current % wheel.size()]);
+        std::vector<Timer> later;
+        for (Timer &timer : slot) {
+            if (timer.rounds) {
+                timer.rounds--;
+                later.push_back(timer);
+            } else {
+                count--;
+                timer.callback();
+            }
+        }
+        std::vector<Timer> &kept = wheel[current % wheel.size()];
+        kept.insert(kept.end(), later.begin(), later.end());
+    }
+}
+
+void TimerWheel::expire_all()
+{
+    while (count) {
+        for (auto &slot : wheel) {
+            std::vector<Timer> timers;
+            timers.swap(slot);
+            count -= timers.size();
+            for (Timer &timer : timers)
+                timer.callback();
+        }
+    }
+}
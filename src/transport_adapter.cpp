@@ -0,0 +1,851 @@
+#include "transport_adapter.h"
+#include "thread_stats.h"
+#include <new>
+#include <math.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+#define RTCP_SR     200
+#define RTCP_XR     207
+#define RTP_EXT_ONE_BYTE    0xBEDE
+#define NTP_UNIX_OFFSET     2208988800UL    // 1900 to 1970, in seconds
+
+static pjmedia_transport_op adapter_op;
+
+const int owd_bucket_us[OWD_BUCKETS] = {
+    0, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, INT_MAX
+};
+
+TransportAdapter::TransportAdapter(pjmedia_transport *slave) :
+    slave(slave), stream_ref(NULL), stream_user_data(NULL),
+    stream_rtp_cb(NULL), stream_rtp_cb2(NULL), stream_rtcp_cb(NULL),
+    rewrite(false), stream_ssrc(0), tx_ssrc(0), seq_offset(0), ts_offset(0),
+    owd_id(0), first_pkt_ns(0), first_pkt_cb(NULL), first_pkt_arg(NULL), srtp(NULL), srtp_on(false),
+    impair_on(false), impair_delay(false), delayed_head(0), delayed_count(0), holding(false),
+    last_due(0), impair_stop(false),
+    ts_mode(kts_off), ts_sock(PJ_INVALID_SOCKET), clock_rate(8000),
+    rx_flow(), tx_flow(), tx_id(0)
+{
+    reset_ts_stat();
+    pj_bzero(&owd_stat, sizeof(owd_stat));
+    pj_math_stat_init(&owd_stat.owd);
+    pj_bzero(&srtp_stat, sizeof(srtp_stat));
+    pj_bzero(&impair_stat, sizeof(impair_stat));
+    pj_bzero(&base, sizeof(base));
+    pj_ansi_strxcpy(base.name, "adapter", sizeof(base.name));
+    base.type = PJMEDIA_TRANSPORT_TYPE_USER;
+    base.op = &adapter_op;
+}
+
+TransportAdapter *TransportAdapter::from(pjmedia_transport *tp)
+{
+    return reinterpret_cast<TransportAdapter *>(tp);
+}
+
+pj_status_t TransportAdapter::create(pjmedia_transport *slave, pjmedia_transport **p_tp)
+{
+    if (!adapter_op.get_info) {
+        adapter_op.get_info = &get_info;
+        adapter_op.attach = &attach;
+        adapter_op.detach = &detach;
+        adapter_op.send_rtp = &send_rtp;
+        adapter_op.send_rtcp = &send_rtcp;
+        adapter_op.send_rtcp2 = &send_rtcp2;
+        adapter_op.media_create = &media_create;
+        adapter_op.encode_sdp = &encode_sdp;
+        adapter_op.media_start = &media_start;
+        adapter_op.media_stop = &media_stop;
+        adapter_op.simulate_lost = &simulate_lost;
+        adapter_op.destroy = &destroy;
+        adapter_op.attach2 = &attach2;
+    }
+
+    TransportAdapter *adapter = new (std::nothrow) TransportAdapter(slave);
+    if (!adapter)
+        return PJ_ENOMEM;
+
+    *p_tp = &adapter->base;
+    return PJ_SUCCESS;
+}
+
+/*
+    Point the stream to a new remote address, as a new RTP session:
+    the outgoing packets get a new SSRC and random sequence/timestamp bases
+*/
+pj_status_t TransportAdapter::retarget(pjmedia_transport *tp, const pj_sockaddr_in *rem_addr,
+                                       const pj_sockaddr_in *rem_rtcp, pj_uint32_t stream_ssrc,
+                                       pj_uint32_t new_ssrc)
+{
+    TransportAdapter *adapter = from(tp);
+    if (!adapter->stream_user_data)
+        return PJ_EINVALIDOP;
+
+    pjmedia_transport_detach(adapter->slave, adapter);
+
+    pjmedia_transport_attach_param param;
+    pj_bzero(&param, sizeof(param));
+    param.stream = adapter->stream_ref;
+    param.media_type = PJMEDIA_TYPE_AUDIO;
+    pj_memcpy(&param.rem_addr, rem_addr, sizeof(pj_sockaddr_in));
+    pj_memcpy(&param.rem_rtcp, rem_rtcp, sizeof(pj_sockaddr_in));
+    param.addr_len = sizeof(pj_sockaddr_in);
+
+    adapter->stream_ssrc = stream_ssrc;
+    adapter->tx_ssrc = new_ssrc;
+    adapter->seq_offset = (pj_uint16_t)pj_rand();
+    adapter->ts_offset = (pj_uint32_t)pj_rand();
+    adapter->rewrite = true;
+
+    return adapter->attach_slave(&param);
+}
+
+/* attach the slave transport to the adapter's callbacks */
+pj_status_t TransportAdapter::attach_slave(pjmedia_transport_attach_param *att_param)
+{
+    att_param->user_data = this;
+    att_param->rtp_cb = NULL;
+    att_param->rtp_cb2 = &rtp_cb2;
+    att_param->rtcp_cb = &rtcp_cb;
+    return pjmedia_transport_attach2(slave, att_param);
+}
+
+void TransportAdapter::rtp_cb2(pjmedia_tp_cb_param *param)
+{
+    TransportAdapter *adapter = (TransportAdapter *)param->user_data;
+    pj_ssize_t size = param->size;
+
+    if (adapter->ts_mode == kts_rx)
+        adapter->ts_received(param->pkt, size);
+    if (adapter->srtp_on && size > 0 && !adapter->unprotect(param->pkt, &size, true))
+        return;
+    if (adapter->owd_id)
+        adapter->owd_received(param->pkt, size);
+    if (!adapter->first_pkt_ns.load(std::memory_order_relaxed))
+        adapter->first_packet();
+
+    if (adapter->stream_rtp_cb2) {
+        pjmedia_tp_cb_param cbparam;
+        pj_memcpy(&cbparam, param, sizeof(cbparam));
+        cbparam.user_data = adapter->stream_user_data;
+        cbparam.size = size;
+        adapter->stream_rtp_cb2(&cbparam);
+    } else if (adapter->stream_rtp_cb) {
+        adapter->stream_rtp_cb(adapter->stream_user_data, param->pkt, size);
+    }
+}
+
+void TransportAdapter::rtcp_cb(void *user_data, void *pkt, pj_ssize_t size)
+{
+    TransportAdapter *adapter = (TransportAdapter *)user_data;
+
+    if (adapter->srtp_on && size > 0 && !adapter->unprotect(pkt, &size, false))
+        return;
+    if (adapter->stream_rtcp_cb)
+        adapter->stream_rtcp_cb(adapter->stream_user_data, pkt, size);
+}
+
+pj_status_t TransportAdapter::get_info(pjmedia_transport *tp, pjmedia_transport_info *info)
+{
+    return pjmedia_transport_get_info(from(tp)->slave, info);
+}
+
+pj_status_t TransportAdapter::attach(pjmedia_transport *tp, void *user_data,
+                                     const pj_sockaddr_t *rem_addr, const pj_sockaddr_t *rem_rtcp,
+                                     unsigned addr_len,
+                                     void (*rtp_cb)(void *, void *, pj_ssize_t),
+                                     void (*rtcp_cb)(void *, void *, pj_ssize_t))
+{
+    pjmedia_transport_attach_param param;
+    pj_bzero(&param, sizeof(param));
+    param.media_type = PJMEDIA_TYPE_AUDIO;
+    param.user_data = user_data;
+    pj_memcpy(&param.rem_addr, rem_addr, addr_len);
+    pj_memcpy(&param.rem_rtcp, rem_rtcp, addr_len);
+    param.addr_len = addr_len;
+    param.rtp_cb = rtp_cb;
+    param.rtcp_cb = rtcp_cb;
+    return attach2(tp, &param);
+}
+
+pj_status_t TransportAdapter::attach2(pjmedia_transport *tp, pjmedia_transport_attach_param *att_param)
+{
+    TransportAdapter *adapter = from(tp);
+    PJ_ASSERT_RETURN(adapter->stream_user_data == NULL, PJ_EINVALIDOP);
+
+    /* keep the stream's callbacks; the slave calls back the adapter */
+    adapter->stream_ref = att_param->stream;
+    adapter->stream_user_data = att_param->user_data;
+    adapter->stream_rtp_cb = att_param->rtp_cb;
+    adapter->stream_rtp_cb2 = att_param->rtp_cb2;
+    adapter->stream_rtcp_cb = att_param->rtcp_cb;
+    adapter->rewrite = false;
+
+    pj_status_t status = adapter->attach_slave(att_param);
+    if (status != PJ_SUCCESS)
+        adapter->stream_user_data = NULL;
+    return status;
+}
+
+void TransportAdapter::detach(pjmedia_transport *tp, void *user_data)
+{
+    TransportAdapter *adapter = from(tp);
+    PJ_UNUSED_ARG(user_data);
+
+    if (adapter->stream_user_data) {
+        pjmedia_transport_detach(adapter->slave, adapter);
+        adapter->stream_user_data = NULL;
+        adapter->stream_rtp_cb = NULL;
+        adapter->stream_rtp_cb2 = NULL;
+        adapter->stream_rtcp_cb = NULL;
+    }
+}
+
+pj_status_t TransportAdapter::send_rtp(pjmedia_transport *tp, const void *pkt, pj_size_t size)
+{
+    TransportAdapter *adapter = from(tp);
+    const void *out = pkt;
+
+    /* never in the clear, once SRTP is on */
+    if (adapter->srtp_on && (size < 12 || size > PJMEDIA_MAX_MTU))
+        return PJ_ETOOBIG;
+
+    if ((adapter->rewrite || adapter->owd_id || adapter->srtp_on) &&
+        size >= 12 && size <= PJMEDIA_MAX_MTU) {
+        pj_uint8_t *p = adapter->tx_buf;
+        if (adapter->owd_id)
+            size = adapter->add_send_time((const pj_uint8_t *)pkt, size);
+        else
+            pj_memcpy(p, pkt, size);
+
+        /* RTP header: seq at 2, timestamp at 4, SSRC at 8 */
+        if (adapter->rewrite) {
+            pj_uint16_t seq = (p[2] << 8 | p[3]) + adapter->seq_offset;
+            pj_uint32_t ts = ((pj_uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7]) + adapter->ts_offset;
+            p[2] = seq >> 8;    p[3] = seq;
+            p[4] = ts >> 24;    p[5] = ts >> 16;    p[6] = ts >> 8;    p[7] = ts;
+            p[8] = adapter->tx_ssrc >> 24;  p[9] = adapter->tx_ssrc >> 16;
+            p[10] = adapter->tx_ssrc >> 8;  p[11] = adapter->tx_ssrc;
+        }
+        if (adapter->srtp_on) {
+            pj_status_t status = adapter->protect(p, &size, true);
+            if (status != PJ_SUCCESS)
+                return status;
+        }
+        out = p;
+    }
+
+    pj_status_t status = (adapter->impair_on) ? adapter->impair((const pj_uint8_t *)out, size) :
+                                                adapter->send_out(out, size);
+    if (!adapter->first_pkt_ns.load(std::memory_order_relaxed))
+        adapter->first_packet();
+    return status;
+}
+
+/* to the wire */
+pj_status_t TransportAdapter::send_out(const void *pkt, pj_size_t size)
+{
+    pj_status_t status = pjmedia_transport_send_rtp(slave, pkt, size);
+    if (ts_mode == kts_tx && status == PJ_SUCCESS)
+        ts_sent(pkt, size);
+    return status;
+}
+
+static pj_uint64_t monotonic_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (pj_uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void TransportAdapter::first_packet()
+{
+    pj_uint64_t expected = 0;
+    if (first_pkt_ns.compare_exchange_strong(expected, monotonic_ns()) && first_pkt_cb)
+        first_pkt_cb(first_pkt_arg);
+}
+
+pj_uint64_t TransportAdapter::first_packet_time(pjmedia_transport *tp)
+{
+    return from(tp)->first_pkt_ns.load();
+}
+
+void TransportAdapter::on_first_packet(pjmedia_transport *tp, void (*cb)(void *), void *arg)
+{
+    TransportAdapter *adapter = from(tp);
+    adapter->first_pkt_arg = arg;
+    adapter->first_pkt_cb = cb;
+}
+
+static pj_uint64_t realtime_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (pj_uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* 64-bit NTP timestamp: seconds since 1900, 32-bit fraction */
+static pj_uint64_t ntp_time(pj_uint64_t unix_ns)
+{
+    pj_uint64_t sec = unix_ns / 1000000000 + NTP_UNIX_OFFSET;
+    pj_uint64_t frac = ((unix_ns % 1000000000) << 32) / 1000000000;
+    return sec << 32 | frac;
+}
+
+/*
+    Copy the packet to tx_buf, with its send time in a header extension:
+    RFC 8285 one-byte header, of a 64-bit NTP timestamp (as RFC 6051's).
+    Copied as is if it has an extension already, or would not fit.
+*/
+pj_size_t TransportAdapter::add_send_time(const pj_uint8_t *pkt, pj_size_t size)
+{
+    pj_size_t hdr = 12 + (pkt[0] & 0x0f) * 4;
+    if ((pkt[0] & 0x10) || hdr > size || size + 16 > PJMEDIA_MAX_MTU) {
+        pj_memcpy(tx_buf, pkt, size);
+        return size;
+    }
+
+    pj_uint8_t *p = tx_buf;
+    pj_memcpy(p, pkt, hdr);
+    p[0] |= 0x10;
+    pj_uint8_t *ext = p + hdr;
+    ext[0] = RTP_EXT_ONE_BYTE >> 8;     ext[1] = RTP_EXT_ONE_BYTE & 0xff;
+    ext[2] = 0;                         ext[3] = 3;     // in 32-bit words
+    ext[4] = owd_id << 4 | (8 - 1);
+    pj_uint64_t ntp = ntp_time(realtime_ns());
+    for (int i = 0; i < 8; i++)
+        ext[5 + i] = ntp >> (56 - 8 * i);
+    ext[13] = ext[14] = ext[15] = 0;    // padding
+    pj_memcpy(ext + 16, pkt + hdr, size - hdr);
+    return size + 16;
+}
+
+/* the received packet's one-way delay, if it has its send time */
+void TransportAdapter::owd_received(const void *pkt, pj_ssize_t size)
+{
+    const pj_uint8_t *p = (const pj_uint8_t *)pkt;
+    if (size < 12 || !(p[0] & 0x10))
+        return;
+    pj_ssize_t pos = 12 + (p[0] & 0x0f) * 4;
+    if (pos + 4 > size || (p[pos] << 8 | p[pos + 1]) != RTP_EXT_ONE_BYTE)
+        return;
+    pj_ssize_t end = pos + 4 + (p[pos + 2] << 8 | p[pos + 3]) * 4;
+    if (end > size)
+        return;
+
+    for (pos += 4; pos < end; ) {
+        int id = p[pos] >> 4, len = (p[pos] & 0x0f) + 1;
+        if (id == 0) {                  // padding
+            pos++;
+            continue;
+        }
+        if (id == 15 || pos + 1 + len > end)
+            return;
+        if (id == owd_id && len == 8) {
+            pj_uint64_t sent = 0;
+            for (int i = 0; i < 8; i++)
+                sent = sent << 8 | p[pos + 1 + i];
+            pj_int64_t delta = (pj_int64_t)(ntp_time(realtime_ns()) - sent);
+            int owd_us = (int)(delta / 4294.967296);    // 2^32 per second
+
+            int bucket = 0;
+            while (owd_us > owd_bucket_us[bucket])
+                bucket++;
+            std::lock_guard<std::mutex> lock(ts_mutex);
+            pj_math_stat_update(&owd_stat.owd, owd_us);
+            owd_stat.hist[bucket]++;
+            return;
+        }
+        pos += 1 + len;
+    }
+}
+
+void TransportAdapter::set_owd(pjmedia_transport *tp, int ext_id)
+{
+    TransportAdapter *adapter = from(tp);
+    std::lock_guard<std::mutex> lock(adapter->ts_mutex);
+    adapter->owd_id = (ext_id > 0 && ext_id < 15)? ext_id : 0;
+}
+
+void TransportAdapter::get_owd_stat(pjmedia_transport *tp, OwdStat *stat, bool reset)
+{
+    TransportAdapter *adapter = from(tp);
+    std::lock_guard<std::mutex> lock(adapter->ts_mutex);
+    *stat = adapter->owd_stat;
+    if (reset) {
+        pj_bzero(&adapter->owd_stat, sizeof(adapter->owd_stat));
+        pj_math_stat_init(&adapter->owd_stat.owd);
+    }
+}
+
+int owd_percentile(const OwdStat *stat, unsigned pct)
+{
+    if (!stat->owd.n)
+        return -1;
+    unsigned below = 0;
+    for (int i = 0; i < OWD_BUCKETS; i++) {
+        below += stat->hist[i];
+        if (below * 100ULL >= (unsigned long long)pct * stat->owd.n)
+            return (i < OWD_BUCKETS - 1)? owd_bucket_us[i] : stat->owd.max;
+    }
+    return stat->owd.max;
+}
+
+/*
+    Kernel timestamps of the RTP socket: when the kernel got each packet
+    off the network device (RX), or handed it to it (TX). Our own delays -
+    socket queue, thread scheduling - are then told apart from the
+    network's jitter. The received packets' timestamps are those of
+    SIOCGSTAMPNS, as pjmedia reads the socket itself; the kernel only keeps
+    them without SO_TIMESTAMPING, hence one mode or the other.
+*/
+pj_status_t TransportAdapter::set_timestamping(pjmedia_transport *tp, kernel_ts_mode mode,
+                                               unsigned clock_rate)
+{
+    TransportAdapter *adapter = from(tp);
+    std::lock_guard<std::mutex> lock(adapter->ts_mutex);
+    adapter->clock_rate = clock_rate;
+    if (mode == adapter->ts_mode)
+        return PJ_SUCCESS;
+
+    pjmedia_transport_info tp_info;
+    pjmedia_transport_info_init(&tp_info);
+    pj_status_t status = pjmedia_transport_get_info(adapter->slave, &tp_info);
+    if (status != PJ_SUCCESS)
+        return status;
+    pj_sock_t sock = tp_info.sock_info.rtp_sock;
+
+    int flags = (mode == kts_tx)? SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                                  SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY : 0;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) != 0)
+        return PJ_RETURN_OS_ERROR(errno);
+    if (mode == kts_rx) {
+        /* the first call turns the socket's timestamps on */
+        struct timespec stamp;
+        ioctl(sock, SIOCGSTAMPNS, &stamp);
+    }
+
+    adapter->ts_sock = sock;
+    adapter->ts_mode = mode;
+    adapter->tx_id = 0;             // the kernel's count restarts with SO_TIMESTAMPING
+    adapter->rx_flow.valid = false;
+    adapter->tx_flow.valid = false;
+    adapter->reset_ts_stat();
+    return PJ_SUCCESS;
+}
+
+void TransportAdapter::get_timestamp_stat(pjmedia_transport *tp, KernelTsStat *stat, bool reset)
+{
+    TransportAdapter *adapter = from(tp);
+    std::lock_guard<std::mutex> lock(adapter->ts_mutex);
+    *stat = adapter->ts_stat;
+    if (reset)
+        adapter->reset_ts_stat();
+}
+
+void TransportAdapter::reset_ts_stat()
+{
+    pj_math_stat_init(&ts_stat.rx_jitter);
+    pj_math_stat_init(&ts_stat.rx_interarrival);
+    pj_math_stat_init(&ts_stat.rx_host_delay);
+    pj_math_stat_init(&ts_stat.tx_jitter);
+    pj_math_stat_init(&ts_stat.tx_host_delay);
+}
+
+/* RFC 3550 interarrival jitter, of the kernel times against the RTP timestamps */
+void TransportAdapter::ts_update(TsFlow &flow, pj_math_stat &jitter, pj_math_stat *interarrival,
+                                 pj_uint64_t kernel_ns, pj_uint32_t rtp_ts, pj_uint32_t ssrc)
+{
+    if (flow.valid && flow.ssrc == ssrc) {
+        pj_int64_t elapsed_ns = (pj_int64_t)(kernel_ns - flow.kernel_ns);
+        double d = elapsed_ns * (clock_rate / 1e9) - (pj_int32_t)(rtp_ts - flow.rtp_ts);
+        flow.jitter += (fabs(d) - flow.jitter) / 16;
+        pj_math_stat_update(&jitter, (int)(flow.jitter * 1000000 / clock_rate));
+        if (interarrival)
+            pj_math_stat_update(interarrival, (int)(elapsed_ns / 1000));
+    } else
+        flow.jitter = 0;
+    flow.valid = true;
+    flow.ssrc = ssrc;
+    flow.rtp_ts = rtp_ts;
+    flow.kernel_ns = kernel_ns;
+}
+
+/* in the stream's RX callback, right after pjmedia's read of the packet */
+void TransportAdapter::ts_received(const void *pkt, pj_ssize_t size)
+{
+    struct timespec stamp;
+    if (size < 12 || ioctl(ts_sock, SIOCGSTAMPNS, &stamp) != 0)
+        return;
+    pj_uint64_t now_ns = realtime_ns();
+    pj_uint64_t kernel_ns = (pj_uint64_t)stamp.tv_sec * 1000000000 + stamp.tv_nsec;
+
+    const pj_uint8_t *p = (const pj_uint8_t *)pkt;
+    pj_uint32_t rtp_ts = (pj_uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+    pj_uint32_t ssrc = (pj_uint32_t)p[8] << 24 | p[9] << 16 | p[10] << 8 | p[11];
+
+    std::lock_guard<std::mutex> lock(ts_mutex);
+    pj_math_stat_update(&ts_stat.rx_host_delay, (int)((pj_int64_t)(now_ns - kernel_ns) / 1000));
+    ts_update(rx_flow, ts_stat.rx_jitter, &ts_stat.rx_interarrival, kernel_ns, rtp_ts, ssrc);
+}
+
+/* after a packet is sent: keep its send time, and collect the kernel
+   timestamps of the packets sent so far, from the socket's error queue */
+void TransportAdapter::ts_sent(const void *pkt, pj_size_t size)
+{
+    const pj_uint8_t *p = (const pj_uint8_t *)pkt;
+    TxRecord &record = tx_ring[tx_id++ % TS_TX_RING];
+    record.user_ns = realtime_ns();
+    record.rtp_ts = (pj_uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+    record.ssrc = (pj_uint32_t)p[8] << 24 | p[9] << 16 | p[10] << 8 | p[11];
+    PJ_UNUSED_ARG(size);
+
+    char control[256];
+    while (true) {
+        struct msghdr msg;
+        pj_bzero(&msg, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(ts_sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+            break;
+
+        struct scm_timestamping stamps;
+        struct sock_extended_err err;
+        bool has_stamps = false, has_err = false;
+        for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMPING) {
+                pj_memcpy(&stamps, CMSG_DATA(cm), sizeof(stamps));
+                has_stamps = true;
+            } else if ((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                       (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)) {
+                pj_memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                has_err = true;
+            }
+        }
+        /* ee_data: the packet's count, if still in the ring */
+        if (!has_stamps || !has_err || err.ee_origin != SO_EE_ORIGIN_TIMESTAMPING ||
+            err.ee_info != SCM_TSTAMP_SND || tx_id - err.ee_data - 1 >= TS_TX_RING)
+            continue;
+
+        const TxRecord &sent = tx_ring[err.ee_data % TS_TX_RING];
+        pj_uint64_t kernel_ns = (pj_uint64_t)stamps.ts[0].tv_sec * 1000000000 + stamps.ts[0].tv_nsec;
+        std::lock_guard<std::mutex> lock(ts_mutex);
+        pj_math_stat_update(&ts_stat.tx_host_delay, (int)((pj_int64_t)(kernel_ns - sent.user_ns) / 1000));
+        ts_update(tx_flow, ts_stat.tx_jitter, NULL, kernel_ns, sent.rtp_ts, sent.ssrc);
+    }
+}
+
+/*
+    SRTP, on pjmedia's SRTP transport: used for its crypto only, the
+    adapter sending and receiving through the slave. Protected after the
+    SSRC/sequence rewriting, as the authentication covers the header.
+    The same master key both ways: each end's SSRC tells them apart.
+*/
+pj_status_t TransportAdapter::set_srtp(pjmedia_transport *tp, pjmedia_endpt *endpt, const char *suite,
+                                       const pj_str_t *key)
+{
+    TransportAdapter *adapter = from(tp);
+    if (adapter->srtp_on) {
+        adapter->srtp_on = false;
+        pjmedia_transport_srtp_stop(adapter->srtp);
+    }
+    if (!suite || !*suite)
+        return PJ_SUCCESS;
+
+    pj_status_t status;
+    if (!adapter->srtp) {
+        pjmedia_srtp_setting opt;
+        pjmedia_srtp_setting_default(&opt);
+        opt.close_member_tp = PJ_FALSE;
+        status = pjmedia_transport_srtp_create(endpt, adapter->slave, &opt, &adapter->srtp);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+
+    pjmedia_srtp_crypto crypto;
+    pj_bzero(&crypto, sizeof(crypto));
+    crypto.key = *key;
+    crypto.name = pj_str(const_cast<char *>(suite));
+    status = pjmedia_transport_srtp_start(adapter->srtp, &crypto, &crypto);
+    if (status == PJ_SUCCESS)
+        adapter->srtp_on = true;
+    return status;
+}
+
+void TransportAdapter::get_srtp_stat(pjmedia_transport *tp, SrtpStat *stat)
+{
+    TransportAdapter *adapter = from(tp);
+    std::lock_guard<std::mutex> lock(adapter->srtp_mutex);
+    *stat = adapter->srtp_stat;
+}
+
+static pj_uint64_t thread_cpu_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (pj_uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* in place; the buffer has room for the trailer */
+pj_status_t TransportAdapter::protect(pj_uint8_t *pkt, pj_size_t *size, bool is_rtp)
+{
+    int len = (int)*size;
+    pj_uint64_t start = thread_cpu_ns();
+    pj_status_t status = pjmedia_transport_srtp_encrypt_pkt(srtp, is_rtp, pkt, &len);
+    pj_uint64_t cpu_ns = thread_cpu_ns() - start;
+    if (status != PJ_SUCCESS)
+        return status;
+
+    *size = len;
+    std::lock_guard<std::mutex> lock(srtp_mutex);
+    srtp_stat.protect_pkts++;
+    srtp_stat.protect_ns += cpu_ns;
+    return PJ_SUCCESS;
+}
+
+bool TransportAdapter::unprotect(void *pkt, pj_ssize_t *size, bool is_rtp)
+{
+    int len = (int)*size;
+    pj_uint64_t start = thread_cpu_ns();
+    pj_status_t status = pjmedia_transport_srtp_decrypt_pkt(srtp, is_rtp, pkt, &len);
+    pj_uint64_t cpu_ns = thread_cpu_ns() - start;
+
+    std::lock_guard<std::mutex> lock(srtp_mutex);
+    srtp_stat.unprotect_pkts++;
+    srtp_stat.unprotect_ns += cpu_ns;
+    if (status != PJ_SUCCESS) {
+        srtp_stat.unprotect_fail++;
+        return false;
+    }
+    *size = len;
+    return true;
+}
+
+/* a new impairment, per call; the queue is allocated with the first one
+   that delays, off the send path */
+void TransportAdapter::set_impairment(pjmedia_transport *tp, const ImpairProfile *profile)
+{
+    TransportAdapter *adapter = from(tp);
+    {
+        std::lock_guard<std::mutex> lock(adapter->impair_mutex);
+        adapter->impairer.configure(*profile);
+        adapter->impair_on = impair_active(profile);
+        adapter->impair_delay = impair_delays(profile);
+        if (adapter->impair_delay && !adapter->delayed)
+            adapter->delayed.reset(new DelaySlot[IMPAIR_SLOTS]);
+        adapter->delayed_count = 0;     // of the previous call
+        adapter->holding = false;
+        adapter->last_due = 0;
+    }
+    if (adapter->impair_delay && !adapter->impair_thread.joinable())
+        adapter->impair_thread = std::thread(&TransportAdapter::impair_sender, adapter);
+}
+
+void TransportAdapter::get_impair_stat(pjmedia_transport *tp, ImpairStat *stat)
+{
+    TransportAdapter *adapter = from(tp);
+    std::lock_guard<std::mutex> lock(adapter->impair_mutex);
+    *stat = adapter->impair_stat;
+}
+
+/* queue a packet at its due time, no earlier than the queued ones; lost
+   if the queue is full */
+void TransportAdapter::delay(const pj_uint8_t *pkt, pj_size_t size, pj_uint64_t due)
+{
+    if (delayed_count == IMPAIR_SLOTS) {
+        impair_stat.lost++;
+        return;
+    }
+    DelaySlot &slot = delayed[(delayed_head + delayed_count++) % IMPAIR_SLOTS];
+    slot.due = due;
+    slot.size = size;
+    pj_memcpy(slot.pkt, pkt, size);
+}
+
+/* a packet's verdict: dropped, sent (twice, if duplicated) now or queued
+   at its due time; a reordered packet is held, to go right after the next
+   one, or after IMPAIR_HOLD_MS if none comes */
+pj_status_t TransportAdapter::impair(const pj_uint8_t *pkt, pj_size_t size)
+{
+    std::unique_lock<std::mutex> lock(impair_mutex);
+    ImpairVerdict verdict = impairer.next();
+    impair_stat.packets++;
+    if (verdict.drop) {
+        impair_stat.lost++;
+        return PJ_SUCCESS;
+    }
+    if (verdict.dup)
+        impair_stat.duplicated++;
+
+    if (!impair_delay || size > sizeof(held.pkt)) {
+        lock.unlock();
+        pj_status_t status = send_out(pkt, size);
+        if (verdict.dup && status == PJ_SUCCESS)
+            status = send_out(pkt, size);
+        return status;
+    }
+
+    pj_uint64_t now = monotonic_ns();
+    pj_uint64_t due = std::max<pj_uint64_t>(now + verdict.delay_us * 1000ULL, last_due);
+    last_due = due;
+    impair_stat.delay_us += (due - now) / 1000;
+    if (!verdict.reorder)
+        delay(pkt, size, due);
+    if (holding) {
+        /* right after this one */
+        delay(held.pkt, held.size, due);
+        holding = false;
+        impair_stat.reordered++;
+    }
+    if (verdict.dup)
+        delay(pkt, size, due);
+    if (verdict.reorder) {
+        held.due = due + IMPAIR_HOLD_MS * 1000000ULL;
+        held.size = size;
+        pj_memcpy(held.pkt, pkt, size);
+        holding = true;
+    }
+    lock.unlock();
+    impair_cv.notify_one();
+    return PJ_SUCCESS;
+}
+
+/* the impairment's thread: the queued packets, at their due time */
+void TransportAdapter::impair_sender()
+{
+    pj_thread_desc thread_desc;
+    pj_thread_t *pj_thread;
+    pj_bzero(thread_desc, sizeof(thread_desc));
+    pj_thread_register("impair", thread_desc, &pj_thread);
+    set_thread_name("ep-impair");
+
+    /* sent from a copy, out of the lock */
+    pj_uint8_t pkt[sizeof(held.pkt)];
+    pj_size_t size;
+    std::unique_lock<std::mutex> lock(impair_mutex);
+    while (!impair_stop) {
+        if (!delayed_count && !holding) {
+            impair_cv.wait(lock);
+            continue;
+        }
+        /* the held packet, only once no other one came for IMPAIR_HOLD_MS */
+        bool from_held = holding && (!delayed_count || held.due < delayed[delayed_head].due);
+        const DelaySlot &first = (from_held)? held : delayed[delayed_head];
+        pj_uint64_t now = monotonic_ns();
+        if (first.due > now) {
+            impair_cv.wait_for(lock, std::chrono::nanoseconds(first.due - now));
+            continue;
+        }
+        size = first.size;
+        pj_memcpy(pkt, first.pkt, size);
+        if (from_held) {
+            holding = false;
+        } else {
+            delayed_head = (delayed_head + 1) % IMPAIR_SLOTS;
+            delayed_count--;
+        }
+        lock.unlock();
+        send_out(pkt, size);
+        lock.lock();
+    }
+}
+
+/* replace the stream's SSRC in every packet of a compound RTCP packet */
+void TransportAdapter::rewrite_rtcp(pj_uint8_t *pkt, pj_size_t size)
+{
+    pj_size_t pos = 0;
+    while (pos + 8 <= size) {
+        pj_uint8_t *p = pkt + pos;
+        pj_size_t len = ((p[2] << 8 | p[3]) + 1) * 4;
+
+        if (p[1] >= RTCP_SR && p[1] <= RTCP_XR) {
+            pj_uint32_t ssrc = (pj_uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+            if (ssrc == stream_ssrc) {
+                p[4] = tx_ssrc >> 24;   p[5] = tx_ssrc >> 16;
+                p[6] = tx_ssrc >> 8;    p[7] = tx_ssrc;
+            }
+        }
+        pos += len;
+    }
+}
+
+pj_status_t TransportAdapter::send_rtcp(pjmedia_transport *tp, const void *pkt, pj_size_t size)
+{
+    return send_rtcp2(tp, NULL, 0, pkt, size);
+}
+
+pj_status_t TransportAdapter::send_rtcp2(pjmedia_transport *tp, const pj_sockaddr_t *addr,
+                                         unsigned addr_len, const void *pkt, pj_size_t size)
+{
+    TransportAdapter *adapter = from(tp);
+
+    if (adapter->srtp_on && size > PJMEDIA_MAX_MTU)
+        return PJ_ETOOBIG;
+    if ((!adapter->rewrite && !adapter->srtp_on) || size > PJMEDIA_MAX_MTU)
+        return pjmedia_transport_send_rtcp2(adapter->slave, addr, addr_len, pkt, size);
+
+    pj_memcpy(adapter->rtcp_buf, pkt, size);
+    if (adapter->rewrite)
+        adapter->rewrite_rtcp(adapter->rtcp_buf, size);
+    if (adapter->srtp_on) {
+        pj_status_t status = adapter->protect(adapter->rtcp_buf, &size, false);
+        if (status != PJ_SUCCESS)
+            return status;
+    }
+    return pjmedia_transport_send_rtcp2(adapter->slave, addr, addr_len, adapter->rtcp_buf, size);
+}
+
+pj_status_t TransportAdapter::media_create(pjmedia_transport *tp, pj_pool_t *sdp_pool, unsigned options,
+                                           const pjmedia_sdp_session *rem_sdp, unsigned media_index)
+{
+    return pjmedia_transport_media_create(from(tp)->slave, sdp_pool, options, rem_sdp, media_index);
+}
+
+pj_status_t TransportAdapter::encode_sdp(pjmedia_transport *tp, pj_pool_t *sdp_pool,
+                                         pjmedia_sdp_session *local_sdp,
+                                         const pjmedia_sdp_session *rem_sdp, unsigned media_index)
+{
+    return pjmedia_transport_encode_sdp(from(tp)->slave, sdp_pool, local_sdp, rem_sdp, media_index);
+}
+
+pj_status_t TransportAdapter::media_start(pjmedia_transport *tp, pj_pool_t *pool,
+                                          const pjmedia_sdp_session *local_sdp,
+                                          const pjmedia_sdp_session *rem_sdp, unsigned media_index)
+{
+    return pjmedia_transport_media_start(from(tp)->slave, pool, local_sdp, rem_sdp, media_index);
+}
+
+pj_status_t TransportAdapter::media_stop(pjmedia_transport *tp)
+{
+    return pjmedia_transport_media_stop(from(tp)->slave);
+}
+
+pj_status_t TransportAdapter::simulate_lost(pjmedia_transport *tp, pjmedia_dir dir, unsigned pct_lost)
+{
+    return pjmedia_transport_simulate_lost(from(tp)->slave, dir, pct_lost);
+}
+
+pj_status_t TransportAdapter::destroy(pjmedia_transport *tp)
+{
+    TransportAdapter *adapter = from(tp);
+
+    if (adapter->impair_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(adapter->impair_mutex);
+            adapter->impair_stop = true;
+        }
+        adapter->impair_cv.notify_one();
+        adapter->impair_thread.join();
+    }
+    if (adapter->srtp)
+        pjmedia_transport_close(adapter->srtp);
+    pjmedia_transport_close(adapter->slave);
+    delete adapter;
+    return PJ_SUCCESS;
+}